@@ -0,0 +1,49 @@
+# This is the Qt project file for the ADRC proxy benchmark.
+#
+# Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+#
+# This file is part of the Equinox.
+#
+# This file may be used under the terms of the GNU General Public
+# License version 3.0 as published by the Free Software Foundation
+# and appearing in the file LICENSE included in the packaging of
+# this file. Alternatively you may (at your option) use any later 
+# version of the GNU General Public License if such license has been
+# publicly approved by Xped Holdings Limited (or its successors,
+# if any) and the KDE Free Qt Foundation.
+#
+# If you are unsure which license is appropriate for your use, please
+# contact the sales department at sales@xped.com.
+#
+# This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+# WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+#
+# Runs the real ADRC proxy code against a local hub stand-in, see main.cpp
+#
+
+# QCommandLineParser and the message handler need Qt 5
+lessThan(QT_MAJOR_VERSION, 5): error("The adrcbench benchmark needs Qt 5")
+
+QT       += core network
+QT       -= gui
+
+TARGET = adrcbench
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += \
+    ../../xpgenlib/adrcproxy
+
+SOURCES += main.cpp \
+    xpadrchubserver.cpp \
+    ../../xpgenlib/adrcproxy/executechannel.cpp \
+    ../../xpgenlib/adrcproxy/xpadrccodec.cpp \
+    ../../xpgenlib/adrcproxy/xpadrciothread.cpp
+
+HEADERS  += \
+    xpadrchubserver.h \
+    ../../xpgenlib/adrcproxy/executechannel.h \
+    ../../xpgenlib/adrcproxy/xpadrccodec.h \
+    ../../xpgenlib/adrcproxy/xpadrciothread.h
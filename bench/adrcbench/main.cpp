@@ -0,0 +1,484 @@
+// This module implements the ADRC proxy benchmark of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#include <stdio.h>
+#include <algorithm>
+
+#include <QList>
+#include <QMutex>
+#include <QBuffer>
+#include <QThread>
+#include <QSemaphore>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+#include <xpadrccodec.h>
+#include <executechannel.h>
+
+#include "xpadrchubserver.h"
+
+// NOTES:
+// 1. The hub stand-in runs on its own thread, the requests go through
+//    the real exec channel and AdrcIoThread like the IDE's.
+// 2. Every request carries its sequence number and the echoed reply
+//    must carry the same one, a mismatch is counted as wrong.
+// 3. The round trip runs use a hub that answers at once, so they time
+//    the exec channel alone. executeRequest() and waitForReply() are
+//    what AdrcTcpProxy::Execute() calls. The late waiter run lets the
+//    reply arrive before waitForReply() is called, the case the old
+//    handshake held up by as much as 100 ms.
+// 4. The old handshake run times the original ExecuteThread handoff in
+//    the same late waiter case for comparison. The reader sleeps in
+//    100 ms steps until the caller is waiting, the code is gone from the
+//    library so it is reproduced here without a socket.
+// 5. The hello timeout runs open fresh connections to a hub that echoes
+//    no ids and answers the hello late, or with --hello silent never.
+//    The first connection waits out ADRCCODEC_HELLO_MSECS and starts
+//    again without a hello, the next one must not wait, and a reply
+//    matched to the wrong request is counted as wrong.
+// 6. The codec runs frame a list reply of a hub with that many devices
+//    in every framing and time encoding and decoding it in memory. The
+//    wire runs send the same replies through a hub and count the bytes.
+// 7. qDebug output is dropped unless --verbose is given.
+//
+
+#define ADRCBENCH_TIMEOUT 30000
+#define ADRCBENCH_LATE_MSECS 20 // head start of the reply over the waiter
+#define ADRCBENCH_CODEC_LOOPS 200
+#define ADRCBENCH_OLD_POLL_MSECS 100 // the original ExecuteThread's msleep()
+
+
+static bool verbose = false;
+
+static void messageHandler(QtMsgType type, const QMessageLogContext& context, const QString& msg)
+{
+    Q_UNUSED(context);
+
+    if (type == QtDebugMsg && !verbose)
+        return;
+
+    fprintf(stderr, "%s\n", qPrintable(msg));
+}
+
+static QString request(int seq)
+{
+    return QString("<adrc><device id='*'><exec>list</exec></device><seq>%1</seq></adrc>").arg(seq);
+}
+
+// What a list reply of a hub with that many devices looks like
+static QString listReply(int seq, int devices)
+{
+    QString xml = QString("<adrc><seq>%1</seq>").arg(seq);
+    for (int i=0; i<devices; i++)
+    {
+        xml += QString("<device id='%1' type='xped.sensor' name='Sensor %1'>"
+                       "<property name='temperature' type='float' value='%2'/>"
+                       "<property name='battery' type='int' value='%3'/>"
+                       "</device>").arg(i).arg(20.0 + (i%50)/10.0).arg(100 - i%100);
+    }
+    xml += "</adrc>";
+
+    return xml;
+}
+
+static bool isReplyTo(const QString& reply, int seq)
+{
+    return reply.contains(QString("<seq>%1</seq>").arg(seq));
+}
+
+// Connect first so only the requests are timed
+static void connectExec(ExecuteChannel *exec)
+{
+    exec->waitForReply(exec->executeRequest(request(-1)), ADRCBENCH_TIMEOUT);
+}
+
+
+class Result
+{
+public:
+    Result(const QString& name) : m_name(name), m_wrong(0) { m_clock.start(); }
+
+    void add(qint64 usecs, bool ok)
+    {
+        m_times.append(usecs);
+        if (!ok)
+            m_wrong++;
+    }
+
+    void print()
+    {
+        qint64 wall = m_clock.elapsed();
+        std::sort(m_times.begin(), m_times.end());
+
+        qint64 total = 0;
+        for (int i=0, n=m_times.count(); i<n; i++)
+            total += m_times.at(i);
+
+        int n = m_times.count();
+        printf("%-28s %6d %6d %9lld %9.1f %9lld %9lld %9lld %9.1f\n", qPrintable(m_name), n, m_wrong, wall,
+               n > 0 ? (double)total/n : 0.0, n > 0 ? m_times.at(n/2) : 0LL, n > 0 ? m_times.at(n*99/100) : 0LL,
+               n > 0 ? m_times.last() : 0LL, wall > 0 ? n*1000.0/wall : 0.0);
+    }
+
+private:
+    QString m_name;
+    QList<qint64> m_times; // usecs per request
+    int m_wrong;
+    QElapsedTimer m_clock;
+};
+
+
+// The reply handoff of the original ExecuteThread, see note 4
+class OldHandshake : public QThread
+{
+public:
+    OldHandshake() : m_waitingForReply(false), m_stop(false) {}
+
+    // Hand the reader a decoded reply
+    void deliver(const QString& reply)
+    {
+        m_replyMutex.lock();
+        m_pending = reply;
+        m_replyMutex.unlock();
+        m_received.release();
+    }
+
+    QString waitForReply(int timeout)
+    {
+        QMutexLocker locker(&m_replyMutex);
+
+        m_waitingForReply = true;
+        m_replyReady.wait(&m_replyMutex, timeout);
+        m_waitingForReply = false;
+
+        return m_reply;
+    }
+
+    void stop()
+    {
+        m_stop = true;
+        m_received.release();
+        wait();
+    }
+
+protected:
+    virtual void run()
+    {
+        forever
+        {
+            m_received.acquire();
+            if (m_stop)
+                return;
+
+            m_replyMutex.lock();
+            while (!m_waitingForReply)
+            {
+                m_replyMutex.unlock();
+                msleep(ADRCBENCH_OLD_POLL_MSECS); // sleep until client is waiting
+                m_replyMutex.lock();
+            }
+            m_reply = m_pending;
+            m_replyReady.wakeOne();
+            m_replyMutex.unlock();
+        }
+    }
+
+private:
+    QMutex m_replyMutex;
+    QWaitCondition m_replyReady;
+    QSemaphore m_received;
+    bool m_waitingForReply;
+    bool m_stop; // read after m_received is acquired
+    QString m_pending;
+    QString m_reply;
+};
+
+
+// Encode and decode cost of one frame, all in memory
+static void runCodec(const QString& name, const QString& xml, AdrcCodec::Version version, bool compression)
+{
+    AdrcCodec codec;
+    codec.setVersion(version, compression);
+
+    QByteArray block = codec.frame(xml);
+    if (block.isEmpty())
+    {
+        printf("%-28s %9d %9s\n", qPrintable(name), xml.size(), "too large");
+        return;
+    }
+
+    QElapsedTimer clock;
+    clock.start();
+    for (int i=0; i<ADRCBENCH_CODEC_LOOPS; i++)
+        block = codec.frame(xml);
+    double encode = clock.nsecsElapsed()/1000.0/ADRCBENCH_CODEC_LOOPS;
+
+    QByteArray stream;
+    for (int i=0; i<ADRCBENCH_CODEC_LOOPS; i++)
+        stream.append(block);
+    QBuffer buffer(&stream);
+    buffer.open(QIODevice::ReadOnly);
+
+    QString decoded;
+    bool ok = true;
+    clock.start();
+    for (int i=0; i<ADRCBENCH_CODEC_LOOPS; i++)
+        ok = codec.readFrame(&buffer, &decoded) && ok;
+    double decode = clock.nsecsElapsed()/1000.0/ADRCBENCH_CODEC_LOOPS;
+
+    printf("%-28s %9d %9d %9.2f %9.1f %9.1f%s\n", qPrintable(name), xml.size(), block.size(),
+           (double)block.size()/xml.size(), encode, decode, (ok && decoded == xml) ? "" : "  wrong");
+}
+
+// One request at a time, each waits for the previous reply
+static void runSequential(const QString& name, const QString& address, quint16 port, int count)
+{
+    ExecuteChannel *exec = new ExecuteChannel(address, port);
+    connectExec(exec);
+    Result result(name);
+    QElapsedTimer clock;
+
+    for (int i=0; i<count; i++)
+    {
+        clock.start();
+        quint32 id = exec->executeRequest(request(i));
+        QString reply = exec->waitForReply(id, ADRCBENCH_TIMEOUT);
+        result.add(clock.nsecsElapsed()/1000, isReplyTo(reply, i));
+    }
+
+    result.print();
+    exec->close();
+}
+
+// The reply is in before the caller asks for it, only the handoff is timed
+static void runLateWaiter(const QString& name, const QString& address, quint16 port, int count)
+{
+    ExecuteChannel *exec = new ExecuteChannel(address, port);
+    connectExec(exec);
+    Result result(name);
+    QElapsedTimer clock;
+
+    for (int i=0; i<count; i++)
+    {
+        quint32 id = exec->executeRequest(request(i));
+        QThread::msleep(ADRCBENCH_LATE_MSECS);
+        clock.start();
+        QString reply = exec->waitForReply(id, ADRCBENCH_TIMEOUT);
+        result.add(clock.nsecsElapsed()/1000, isReplyTo(reply, i));
+    }
+
+    result.print();
+    exec->close();
+}
+
+// The late waiter case through the original handoff
+static void runOldHandshake(const QString& name, int count)
+{
+    OldHandshake handshake;
+    handshake.start();
+    Result result(name);
+    QElapsedTimer clock;
+
+    for (int i=0; i<count; i++)
+    {
+        handshake.deliver(listReply(i, 0));
+        QThread::msleep(ADRCBENCH_LATE_MSECS);
+        clock.start();
+        QString reply = handshake.waitForReply(ADRCBENCH_TIMEOUT);
+        result.add(clock.nsecsElapsed()/1000, isReplyTo(reply, i));
+    }
+
+    result.print();
+    handshake.stop();
+}
+
+// All requests sent up front on the one connection, devices > 0 makes
+// them list replies of that size
+static void runPipelined(const QString& name, const QString& address, quint16 port, int count, int devices = 0)
+{
+    ExecuteChannel *exec = new ExecuteChannel(address, port);
+    connectExec(exec);
+    Result result(name);
+    QElapsedTimer clock;
+    QList<quint32> ids;
+
+    clock.start();
+    for (int i=0; i<count; i++)
+        ids.append(exec->executeRequest(devices > 0 ? listReply(i, devices) : request(i)));
+    for (int i=0; i<count; i++)
+    {
+        QString reply = exec->waitForReply(ids.at(i), ADRCBENCH_TIMEOUT);
+        result.add(clock.nsecsElapsed()/1000, isReplyTo(reply, i));
+    }
+
+    result.print();
+    exec->close();
+}
+
+// Pipelined requests on a new connection, its set up and hello included
+static void runFreshConnection(const QString& name, const QString& address, quint16 port, int count)
+{
+    ExecuteChannel *exec = new ExecuteChannel(address, port);
+    Result result(name);
+    QElapsedTimer clock;
+    QList<quint32> ids;
+
+    clock.start();
+    for (int i=0; i<count; i++)
+        ids.append(exec->executeRequest(request(i)));
+    for (int i=0; i<count; i++)
+    {
+        QString reply = exec->waitForReply(ids.at(i), ADRCBENCH_TIMEOUT);
+        result.add(clock.nsecsElapsed()/1000, isReplyTo(reply, i));
+    }
+
+    result.print();
+    exec->close();
+}
+
+// The same list replies through a hub speaking the given framing
+static void runWire(const QString& name, XPAdrcHubServer *hub, const QString& address, AdrcCodec::Version version,
+                    bool compression, int count, int devices)
+{
+    hub->setProtocol(version);
+    hub->setCompression(compression);
+    quint64 bytes = hub->wireBytes();
+
+    runPipelined(name, address, hub->execPort(), count, devices);
+    printf("%-28s %9llu wire bytes\n", "", hub->wireBytes() - bytes);
+
+    hub->setProtocol(AdrcCodec::Version2);
+    hub->setCompression(true);
+}
+
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setOrganizationName("Xped");
+    QCoreApplication::setApplicationName("adrcbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("ADRC framing and exec channel against a local hub stand-in");
+    parser.addHelpOption();
+    QCommandLineOption delayOption("delay", "Hub processing time of every request.", "msecs", "5");
+    QCommandLineOption jitterOption("jitter", "Random extra processing time.", "msecs", "5");
+    QCommandLineOption countOption("count", "Requests per run.", "n", "100");
+    QCommandLineOption devicesOption("devices", "Devices in the list replies.", "n", "100");
+    QCommandLineOption helloOption("hello", "Hub answer to the hello in the timeout runs, late or silent.", "mode", "late");
+    QCommandLineOption verboseOption("verbose", "Show the library's debug output.");
+    parser.addOption(delayOption);
+    parser.addOption(jitterOption);
+    parser.addOption(countOption);
+    parser.addOption(devicesOption);
+    parser.addOption(helloOption);
+    parser.addOption(verboseOption);
+    parser.process(app);
+
+    verbose = parser.isSet(verboseOption);
+    qInstallMessageHandler(messageHandler);
+
+    int count = qMax(1, parser.value(countOption).toInt());
+    int devices = qMax(1, parser.value(devicesOption).toInt());
+
+    // Framing alone, small, medium and too large for version 1
+    printf("%-28s %9s %9s %9s %9s %9s\n", "codec", "chars", "bytes", "ratio", "enc us", "dec us");
+    QList<int> sizes;
+    sizes << 1 << devices << devices*10;
+    for (int i=0; i<sizes.count(); i++)
+    {
+        QString xml = listReply(0, sizes.at(i));
+        runCodec(QString("v1, %1 devices").arg(sizes.at(i)), xml, AdrcCodec::Version1, false);
+        runCodec(QString("v2, %1 devices").arg(sizes.at(i)), xml, AdrcCodec::Version2, false);
+        runCodec(QString("v2 deflate, %1 devices").arg(sizes.at(i)), xml, AdrcCodec::Version2, true);
+    }
+    printf("\n");
+
+    // The hub stand-in on its own thread
+    QThread hubThread;
+    XPAdrcHubServer *hub = new XPAdrcHubServer();
+    hub->setDelay(parser.value(delayOption).toInt());
+    hub->setJitter(parser.value(jitterOption).toInt());
+    hub->moveToThread(&hubThread);
+    QObject::connect(&hubThread, SIGNAL(finished()), hub, SLOT(deleteLater()));
+    hubThread.start();
+
+    bool started = false;
+    QMetaObject::invokeMethod(hub, "start", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, started));
+    if (!started)
+    {
+        fprintf(stderr, "Unable to start the hub stand-in\n");
+        hubThread.quit();
+        hubThread.wait();
+        return 1;
+    }
+
+    QString address("127.0.0.1");
+    quint16 port = hub->execPort();
+
+    printf("delay=%dms jitter=%dms count=%d\n\n", hub->delay(), hub->jitter(), count);
+    printf("%-28s %6s %6s %9s %9s %9s %9s %9s %9s\n", "scenario", "reqs", "wrong", "wall ms", "mean us", "p50 us",
+           "p99 us", "max us", "req/s");
+
+    // Round trips through an instant echo
+    hub->setDelay(0);
+    hub->setJitter(0);
+    runSequential("roundtrip", address, port, count);
+    runLateWaiter("roundtrip, late waiter", address, port, qMin(count, 50));
+    runOldHandshake("late waiter, old handshake", qMin(count, 50));
+    hub->setDelay(parser.value(delayOption).toInt());
+    hub->setJitter(parser.value(jitterOption).toInt());
+
+    runSequential("exec sequential", address, port, count);
+    runPipelined("exec pipelined", address, port, count);
+
+    // A hub that neither echoes the ids nor reorders
+    hub->setEchoIds(false);
+    runPipelined("exec pipelined, no ids", address, port, count);
+
+    hub->setEchoIds(true);
+
+    // List replies on the wire in every framing
+    hub->setDelay(0);
+    hub->setJitter(0);
+    runWire(QString("list v1, %1 devices").arg(devices), hub, address, AdrcCodec::Version1, false, count, devices);
+    runWire(QString("list v2, %1 devices").arg(devices), hub, address, AdrcCodec::Version2, false, count, devices);
+    runWire(QString("list v2 deflate, %1 devices").arg(devices), hub, address, AdrcCodec::Version2, true, count, devices);
+
+    // A hub that leaves the hello unanswered, see note 5. Last, the
+    // channels remember the port as silent for the rest of the process
+    QString hello = parser.value(helloOption);
+    hub->setEchoIds(false);
+    hub->setHelloSilent(hello == "silent");
+    hub->setHelloLate(hello != "silent");
+    runFreshConnection(QString("%1 hello, 1st connection").arg(hello), address, port, count);
+    runFreshConnection(QString("%1 hello, 2nd connection").arg(hello), address, port, count);
+
+    printf("\nhub requests=%llu\n", hub->requestCount());
+
+    hubThread.quit();
+    hubThread.wait();
+
+    return 0;
+}
+
+// End of file
@@ -0,0 +1,255 @@
+// This module implements the local ADRC hub stand-in of the XPGENLIB benchmarks.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#include <QDebug>
+#include <QRegExp>
+#include <QHostAddress>
+
+#include <executechannel.h>
+#include <xpadrccodec.h>
+
+#include "xpadrchubserver.h"
+
+// NOTES:
+// 1. Frames are read and written with an AdrcCodec per connection, the
+//    hello answer switches it to the framing agreed on.
+// 2. The reply to a request is the request itself, cid included when
+//    the hub echoes ids, so callers can check they got their own reply.
+// 3. With ids echoed each reply goes out when its time is up, otherwise
+//    replies keep the order of the requests like the old daemon.
+// 4. A version 1 hub answers the hello like any request it can't make
+//    sense of, on the signal port it ignores it. A silent hub ignores it
+//    on both ports, a late one answers it like a version 1 hub but
+//    after twice ADRCCODEC_HELLO_MSECS, queued ahead of the requests.
+//
+
+#define XPADRCHUBSERVER_UNKNOWN_REPLY "<adrc><error>unknown request</error></adrc>"
+
+
+//
+// XPAdrcHubServer
+//
+
+XPAdrcHubServer::XPAdrcHubServer(QObject *parent)
+    : QObject(parent), m_exec(this), m_signal(this), m_delay(0), m_jitter(0), m_echoIds(true),
+      m_protocol(AdrcCodec::Version2), m_compression(true), m_helloSilent(false),
+      m_helloLate(false), m_requestCount(0), m_wireBytes(0)
+{
+    connect(&m_exec, SIGNAL(newConnection()), this, SLOT(onExecConnection()));
+    connect(&m_signal, SIGNAL(newConnection()), this, SLOT(onSignalConnection()));
+}
+
+bool XPAdrcHubServer::start(quint16 port)
+{
+    // The signal service must get the port above the exec one
+    for (int attempt=0; attempt<16; attempt++)
+    {
+        if (!m_exec.listen(QHostAddress::LocalHost, port))
+            break;
+        if (m_signal.listen(QHostAddress::LocalHost, m_exec.serverPort()+1))
+        {
+            qDebug() << "XPAdrcHubServer::start exec port=" << m_exec.serverPort() << "signal port=" << m_signal.serverPort();
+            return true;
+        }
+        m_exec.close();
+        if (port != 0)
+            break;
+    }
+
+    qDebug() << "XPAdrcHubServer::start listen error=" << m_exec.errorString() << m_signal.errorString();
+
+    return false;
+}
+
+void XPAdrcHubServer::broadcastSignal(const QString& sigxml)
+{
+    QHash<QTcpSocket *, AdrcCodec>::const_iterator i;
+    for (i = m_signalSockets.constBegin(); i != m_signalSockets.constEnd(); ++i)
+        i.key()->write(i.value().frame(sigxml));
+}
+
+void XPAdrcHubServer::onExecConnection()
+{
+    while (m_exec.hasPendingConnections())
+        new XPAdrcHubConnection(m_exec.nextPendingConnection(), this);
+}
+
+void XPAdrcHubServer::onSignalConnection()
+{
+    while (m_signal.hasPendingConnections())
+    {
+        QTcpSocket *socket = m_signal.nextPendingConnection();
+        connect(socket, SIGNAL(readyRead()), this, SLOT(onSignalReadyRead()));
+        connect(socket, SIGNAL(disconnected()), this, SLOT(onSignalDisconnected()));
+        m_signalSockets.insert(socket, AdrcCodec());
+    }
+}
+
+void XPAdrcHubServer::onSignalReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    AdrcCodec& codec = m_signalSockets[socket];
+
+    // Nothing but the hello is read on the signal port
+    QString xml;
+    while (codec.readFrame(socket, &xml))
+    {
+        if (m_protocol < AdrcCodec::Version2 || m_helloSilent)
+            continue;
+
+        QString answer = AdrcCodec::answerHello(xml, m_protocol, m_compression);
+        if (answer.isEmpty())
+            continue;
+
+        socket->write(codec.frame(answer));
+        codec.acceptHello(answer);
+    }
+}
+
+void XPAdrcHubServer::onSignalDisconnected()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    m_signalSockets.remove(socket);
+    socket->deleteLater();
+}
+
+
+//
+// XPAdrcHubConnection
+//
+
+XPAdrcHubConnection::XPAdrcHubConnection(QTcpSocket *socket, XPAdrcHubServer *server)
+    : QObject(server), m_server(server), m_socket(socket), m_helloDone(false)
+{
+    m_socket->setParent(this);
+    m_socket->setSocketOption(QAbstractSocket::LowDelayOption, QVariant(1));
+    m_clock.start();
+
+    m_timer.setSingleShot(true);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(onReplyDue()));
+
+    connect(m_socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+    connect(m_socket, SIGNAL(disconnected()), this, SLOT(deleteLater()));
+}
+
+void XPAdrcHubConnection::onReadyRead()
+{
+    qint64 available = m_socket->bytesAvailable();
+
+    forever
+    {
+        Pending pending;
+        if (!m_codec.readFrame(m_socket, &pending.xml))
+            break;
+
+        if (!m_helloDone)
+        {
+            m_helloDone = true;
+            if (answerHello(pending.xml))
+                continue;
+        }
+
+        if (!m_server->echoIds())
+            pending.xml.replace(QRegExp(QString("\\s%1=\"\\d+\"").arg(EXECUTECHANNEL_CID_ATTR)), QString());
+
+        int jitter = (m_server->jitter() > 0) ? qrand() % (m_server->jitter()+1) : 0;
+        pending.due = m_clock.elapsed() + m_server->delay() + jitter;
+        m_pending.append(pending);
+        m_server->countRequest();
+    }
+
+    m_server->countBytes(available - m_socket->bytesAvailable());
+
+    if (m_codec.isCorrupt())
+    {
+        qDebug() << "XPAdrcHubConnection dropping connection on a corrupt frame";
+        m_socket->abort();
+        return;
+    }
+
+    onReplyDue();
+}
+
+bool XPAdrcHubConnection::answerHello(const QString& xml)
+{
+    AdrcCodec::Version version;
+    bool compression;
+    if (!AdrcCodec::parseHello(xml, &version, &compression))
+        return false;
+    if (m_server->helloSilent())
+        return true; // dropped unanswered
+    if (m_server->helloLate())
+    {
+        Pending pending;
+        pending.due = m_clock.elapsed() + 2*ADRCCODEC_HELLO_MSECS;
+        pending.xml = XPADRCHUBSERVER_UNKNOWN_REPLY;
+        m_pending.append(pending);
+        return true;
+    }
+
+    QString answer = XPADRCHUBSERVER_UNKNOWN_REPLY;
+    if (m_server->protocol() >= AdrcCodec::Version2)
+        answer = AdrcCodec::answerHello(xml, m_server->protocol(), m_server->compression());
+
+    quint32 id;
+    if (m_server->echoIds() && ExecuteChannel::replyId(xml, &id))
+        answer = ExecuteChannel::tagRequest(answer, id);
+
+    // The answer still goes in the old framing
+    writeFrame(answer);
+    m_codec.acceptHello(answer);
+
+    return true;
+}
+
+void XPAdrcHubConnection::writeFrame(const QString& xml)
+{
+    QByteArray block = m_codec.frame(xml);
+    m_server->countBytes(block.size());
+    m_socket->write(block);
+}
+
+void XPAdrcHubConnection::onReplyDue()
+{
+    qint64 now = m_clock.elapsed();
+    qint64 next = -1;
+
+    for (int i=0; i<m_pending.count(); )
+    {
+        if (m_pending.at(i).due <= now)
+        {
+            writeFrame(m_pending.at(i).xml);
+            m_pending.removeAt(i);
+            continue;
+        }
+
+        // In order replies wait for the oldest one
+        if (next < 0 || m_pending.at(i).due < next)
+            next = m_pending.at(i).due;
+        if (!m_server->echoIds())
+            break;
+        i++;
+    }
+
+    if (next >= 0)
+        m_timer.start(qMax<qint64>(0, next - now));
+}
+
+// End of file
@@ -0,0 +1,147 @@
+// This module defines the local ADRC hub stand-in of the XPGENLIB benchmarks.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#ifndef XPADRCHUBSERVER_H
+#define XPADRCHUBSERVER_H
+
+#include <QHash>
+#include <QList>
+#include <QTimer>
+#include <QString>
+#include <QObject>
+#include <QElapsedTimer>
+#include <QByteArray>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#include <xpadrccodec.h>
+
+class XPAdrcHubServer;
+
+
+/*
+ * Echo server standing in for the ADRC daemon of a hub: the exec port
+ * answers every request with the request itself, the port above it
+ * accepts signal connections and can broadcast signals
+ */
+
+class XPAdrcHubServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit XPAdrcHubServer(QObject *parent = 0);
+
+    // Processing time of every request and random extra time on top,
+    // jitter makes a hub that echoes the ids answer out of order
+    void setDelay(int msecs) { m_delay = msecs; }
+    void setJitter(int msecs) { m_jitter = msecs; }
+    int delay() { return m_delay; }
+    int jitter() { return m_jitter; }
+
+    // Hubs before correlation ids answer in order and drop the cid
+    void setEchoIds(bool echo) { m_echoIds = echo; }
+    bool echoIds() { return m_echoIds; }
+
+    // Framing agreed on for new connections, hubs before version 2
+    // answer the hello as an unknown request
+    void setProtocol(AdrcCodec::Version version) { m_protocol = version; }
+    void setCompression(bool compression) { m_compression = compression; }
+    AdrcCodec::Version protocol() { return m_protocol; }
+    bool compression() { return m_compression; }
+
+    // A hub that drops the hello without a word, or answers it as an
+    // unknown request only once the client has given up on it
+    void setHelloSilent(bool silent) { m_helloSilent = silent; }
+    void setHelloLate(bool late) { m_helloLate = late; }
+    bool helloSilent() { return m_helloSilent; }
+    bool helloLate() { return m_helloLate; }
+
+    quint16 execPort() { return m_exec.serverPort(); }
+    quint64 requestCount() { return m_requestCount; }
+    void countRequest() { m_requestCount++; }
+    quint64 wireBytes() { return m_wireBytes; } // exec bytes both ways
+    void countBytes(qint64 bytes) { m_wireBytes += bytes; }
+
+public slots:
+    // Listen on the loopback interface, the signal port is execPort()+1
+    bool start(quint16 port = 0);
+    void broadcastSignal(const QString& sigxml);
+
+private slots:
+    void onExecConnection();
+    void onSignalConnection();
+    void onSignalReadyRead();
+    void onSignalDisconnected();
+
+private:
+    QTcpServer m_exec;
+    QTcpServer m_signal;
+    QHash<QTcpSocket *, AdrcCodec> m_signalSockets;
+    int m_delay;
+    int m_jitter;
+    bool m_echoIds;
+    AdrcCodec::Version m_protocol;
+    bool m_compression;
+    bool m_helloSilent;
+    bool m_helloLate;
+    quint64 m_requestCount;
+    quint64 m_wireBytes;
+};
+
+
+/*
+ * One exec connection, requests are read as soon as they arrive and
+ * answered when their processing time is up
+ */
+
+class XPAdrcHubConnection : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit XPAdrcHubConnection(QTcpSocket *socket, XPAdrcHubServer *server);
+
+private slots:
+    void onReadyRead();
+    void onReplyDue();
+
+private:
+    bool answerHello(const QString& xml);
+    void writeFrame(const QString& xml);
+
+private:
+    struct Pending
+    {
+        qint64 due; // msecs since the connection started
+        QString xml;
+    };
+
+private:
+    XPAdrcHubServer *m_server;
+    QTcpSocket *m_socket;
+    AdrcCodec m_codec;
+    bool m_helloDone; // only the first frame can be a hello
+    QList<Pending> m_pending; // in arrival order
+    QElapsedTimer m_clock;
+    QTimer m_timer;
+};
+
+#endif // XPADRCHUBSERVER_H
@@ -0,0 +1,292 @@
+// This module implements the XPNetFile benchmark of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#include <stdio.h>
+#include <algorithm>
+
+#include <QDir>
+#include <QFile>
+#include <QList>
+#include <QFileInfo>
+#include <QThread>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+#include <xpnetfile.h>
+#include <xpnetbatch.h>
+#include <xpnetmetrics.h>
+
+#include "xpnethubserver.h"
+
+// NOTES:
+// 1. The hub stand-in runs on its own thread so the measured XPNetFile
+//    calls go through the real pool, workers and cache like in the app.
+// 2. The cache root is a temporary directory, set before the first
+//    XPNetFile touches the ETag index.
+// 3. Every scenario prints the count, mean, median and worst time and
+//    the throughput, the transfer metrics follow at the end.
+// 4. qDebug output is dropped unless --verbose is given.
+//
+
+#define NETBENCH_SMALL_SIZE (4*1024)
+#define NETBENCH_MANY_COUNT 200
+#define NETBENCH_TIMEOUT 120000
+
+
+static bool verbose = false;
+
+static void messageHandler(QtMsgType type, const QMessageLogContext& context, const QString& msg)
+{
+    Q_UNUSED(context);
+
+    if (type == QtDebugMsg && !verbose)
+        return;
+
+    fprintf(stderr, "%s\n", qPrintable(msg));
+}
+
+static QByteArray makeData(qint64 size, int seed)
+{
+    QByteArray data(size, 0);
+    quint32 x = 2463534242u + seed;
+
+    // Cheap xorshift noise, compressible data would flatter the gzip PUT
+    for (qint64 i=0; i<size; i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        data[(int)i] = (char)x;
+    }
+
+    return data;
+}
+
+static bool writeFile(const QString& path, const QByteArray& data)
+{
+    QDir dir;
+    dir.mkpath(QFileInfo(path).path());
+
+    QFile file(path);
+    return file.open(QFile::WriteOnly) && file.write(data) == data.size();
+}
+
+
+class Result
+{
+public:
+    Result(const QString& name) : m_name(name), m_bytes(0), m_failed(0) { m_clock.start(); }
+
+    void add(qint64 msecs, qint64 bytes, bool ok)
+    {
+        m_times.append(msecs);
+        m_bytes += bytes;
+        if (!ok)
+            m_failed++;
+    }
+
+    void print()
+    {
+        qint64 wall = m_clock.elapsed();
+        std::sort(m_times.begin(), m_times.end());
+
+        qint64 total = 0;
+        for (int i=0, n=m_times.count(); i<n; i++)
+            total += m_times.at(i);
+
+        int n = m_times.count();
+        double mbps = wall > 0 ? (m_bytes/(1024.0*1024.0)) / (wall/1000.0) : 0;
+        printf("%-24s %6d %6d %9.1f %9lld %9lld %10.2f\n", qPrintable(m_name), n, m_failed,
+               n > 0 ? (double)total/n : 0.0, n > 0 ? m_times.at(n/2) : 0LL,
+               n > 0 ? m_times.last() : 0LL, mbps);
+    }
+
+private:
+    QString m_name;
+    QList<qint64> m_times; // msecs per operation
+    qint64 m_bytes;
+    int m_failed;
+    QElapsedTimer m_clock;
+};
+
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setOrganizationName("Xped");
+    QCoreApplication::setApplicationName("netbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("XPNetFile transfers against a local hub stand-in");
+    parser.addHelpOption();
+    QCommandLineOption latencyOption("latency", "Delay before every response.", "msecs", "0");
+    QCommandLineOption bandwidthOption("bandwidth", "Hub bandwidth cap, 0 for none.", "KB/s", "0");
+    QCommandLineOption largeOption("large", "Size of the large file.", "MB", "32");
+    QCommandLineOption countOption("count", "Repeats of the single file runs.", "n", "20");
+    QCommandLineOption verboseOption("verbose", "Show the library's debug output.");
+    parser.addOption(latencyOption);
+    parser.addOption(bandwidthOption);
+    parser.addOption(largeOption);
+    parser.addOption(countOption);
+    parser.addOption(verboseOption);
+    parser.process(app);
+
+    verbose = parser.isSet(verboseOption);
+    qInstallMessageHandler(messageHandler);
+
+    int count = qMax(1, parser.value(countOption).toInt());
+    qint64 largeSize = qMax(1, parser.value(largeOption).toInt()) * 1024LL*1024LL;
+
+    // Cache and hub trees, the cache must be set before any XPNetFile use
+    QTemporaryDir cacheDir;
+    QTemporaryDir hubDir;
+    if (!cacheDir.isValid() || !hubDir.isValid())
+    {
+        fprintf(stderr, "Unable to create the temporary directories\n");
+        return 1;
+    }
+    qputenv("XP_RDFCACHE_PATH", cacheDir.path().toUtf8());
+
+    // The hub stand-in on its own thread
+    QThread hubThread;
+    XPNetHubServer *hub = new XPNetHubServer(hubDir.path());
+    hub->setLatency(parser.value(latencyOption).toInt());
+    hub->setBandwidth(parser.value(bandwidthOption).toLongLong()*1024);
+    hub->moveToThread(&hubThread);
+    QObject::connect(&hubThread, SIGNAL(finished()), hub, SLOT(deleteLater()));
+    hubThread.start();
+
+    bool started = false;
+    QMetaObject::invokeMethod(hub, "start", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, started));
+    if (!started)
+    {
+        fprintf(stderr, "Unable to start the hub stand-in\n");
+        hubThread.quit();
+        hubThread.wait();
+        return 1;
+    }
+
+    QString base = QString("http://127.0.0.1:%1").arg(hub->serverPort());
+    QString cache = cacheDir.path();
+
+    // Hub content
+    QByteArray small = makeData(NETBENCH_SMALL_SIZE, 0);
+    QByteArray large = makeData(largeSize, 1);
+    writeFile(hubDir.path() + "/bench/small.bin", small);
+    writeFile(hubDir.path() + "/bench/large.bin", large);
+    for (int i=0; i<NETBENCH_MANY_COUNT; i++)
+        writeFile(QString("%1/bench/many/%2.bin").arg(hubDir.path()).arg(i), makeData(NETBENCH_SMALL_SIZE, i+2));
+
+    printf("latency=%dms bandwidth=%lldKB/s large=%lldMB count=%d\n\n", hub->latency(), hub->bandwidth()/1024,
+           largeSize/(1024*1024), count);
+    printf("%-24s %6s %6s %9s %9s %9s %10s\n", "scenario", "ops", "failed", "mean ms", "p50 ms", "max ms", "MB/s");
+
+    QElapsedTimer clock;
+
+    // Single small file, nothing cached
+    {
+        Result result("small GET cold");
+        for (int i=0; i<count; i++)
+        {
+            XPNetFile file(QUrl(base + "/bench/small.bin"), QString("%1/cold/%2/small.bin").arg(cache).arg(i));
+            clock.start();
+            bool ok = file.exists(NETBENCH_TIMEOUT);
+            result.add(clock.elapsed(), ok ? small.size() : 0, ok);
+        }
+        result.print();
+    }
+
+    // The same file again, answered with 304
+    {
+        Result result("small GET revalidate");
+        XPNetFile file(QUrl(base + "/bench/small.bin"), cache + "/cold/0/small.bin");
+        for (int i=0; i<count; i++)
+        {
+            file.invalidate();
+            clock.start();
+            bool ok = file.exists(NETBENCH_TIMEOUT);
+            result.add(clock.elapsed(), 0, ok);
+        }
+        result.print();
+    }
+
+    // Many small files in one batch
+    {
+        Result result(QString("%1 small GET batch").arg(NETBENCH_MANY_COUNT));
+        QList<XPNetBatchItem> items;
+        for (int i=0; i<NETBENCH_MANY_COUNT; i++)
+            items.append(XPNetBatchItem(QUrl(QString("%1/bench/many/%2.bin").arg(base).arg(i)),
+                                        QString("%1/many/%2.bin").arg(cache).arg(i)));
+
+        clock.start();
+        XPNetBatch *batch = XPNetFile::fetchMany(items);
+        batch->waitForFinished(NETBENCH_TIMEOUT);
+        qint64 elapsed = clock.elapsed();
+        for (int i=0, n=batch->count(); i<n; i++)
+            result.add(elapsed, batch->isOk(i) ? NETBENCH_SMALL_SIZE : 0, batch->isOk(i));
+        delete batch;
+        result.print();
+    }
+
+    // Large file, segmented if it is big enough
+    {
+        Result result("large GET");
+        XPNetFile file(QUrl(base + "/bench/large.bin"), cache + "/large.bin");
+        clock.start();
+        bool ok = file.exists(NETBENCH_TIMEOUT);
+        result.add(clock.elapsed(), ok ? large.size() : 0, ok);
+        result.print();
+    }
+
+    // Small uploads from memory
+    {
+        Result result("small PUT");
+        for (int i=0; i<count; i++)
+        {
+            XPNetFile file(QUrl(QString("%1/bench/put/%2.bin").arg(base).arg(i)), QString());
+            clock.start();
+            bool ok = file.put(small, NETBENCH_TIMEOUT);
+            result.add(clock.elapsed(), ok ? small.size() : 0, ok);
+        }
+        result.print();
+    }
+
+    // Large upload from memory
+    {
+        Result result("large PUT");
+        XPNetFile file(QUrl(base + "/bench/put/large.bin"), QString());
+        clock.start();
+        bool ok = file.put(large, NETBENCH_TIMEOUT);
+        result.add(clock.elapsed(), ok ? large.size() : 0, ok);
+        result.print();
+    }
+
+    printf("\nhub requests=%llu\n\n%s\n", hub->requestCount(), qPrintable(XPNetMetrics::instance()->summary()));
+
+    hubThread.quit();
+    hubThread.wait();
+
+    return 0;
+}
+
+// End of file
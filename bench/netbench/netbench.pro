@@ -0,0 +1,84 @@
+# This is the Qt project file for the XPNetFile benchmark.
+#
+# Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+#
+# This file is part of the Equinox.
+#
+# This file may be used under the terms of the GNU General Public
+# License version 3.0 as published by the Free Software Foundation
+# and appearing in the file LICENSE included in the packaging of
+# this file. Alternatively you may (at your option) use any later 
+# version of the GNU General Public License if such license has been
+# publicly approved by Xped Holdings Limited (or its successors,
+# if any) and the KDE Free Qt Foundation.
+#
+# If you are unsure which license is appropriate for your use, please
+# contact the sales department at sales@xped.com.
+#
+# This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+# WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+#
+# Runs the real XPNetFile code against a local hub stand-in, see main.cpp
+#
+
+# QCommandLineParser, QTemporaryDir and the message handler need Qt 5
+lessThan(QT_MAJOR_VERSION, 5): error("The netbench benchmark needs Qt 5")
+
+QT       += core network
+QT       -= gui
+
+TARGET = netbench
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+DEFINES += XPGENLIBMOBILE_LIBRARY
+
+INCLUDEPATH += \
+    ../../xpgenlib \
+    ../../xpgenlib/netfile
+
+LIBS += \
+    -lz
+
+SOURCES += main.cpp \
+    xpnethubserver.cpp \
+    ../../xpgenlib/netfile/xpnetfile.cpp \
+    ../../xpgenlib/netfile/xpnetfileview.cpp \
+    ../../xpgenlib/netfile/xpnetfileutil.cpp \
+    ../../xpgenlib/netfile/xpgzipdevice.cpp \
+    ../../xpgenlib/netfile/xpnetbatch.cpp \
+    ../../xpgenlib/netfile/xpnetcachemanager.cpp \
+    ../../xpgenlib/netfile/xpnetcachepolicy.cpp \
+    ../../xpgenlib/netfile/xpnetdelta.cpp \
+    ../../xpgenlib/netfile/xpnetetagindex.cpp \
+    ../../xpgenlib/netfile/xpnetmetrics.cpp \
+    ../../xpgenlib/netfile/xpnetpackstore.cpp \
+    ../../xpgenlib/netfile/xpnetpool.cpp \
+    ../../xpgenlib/netfile/xpnetsync.cpp \
+    ../../xpgenlib/netfile/xpprivategetworker.cpp \
+    ../../xpgenlib/netfile/xpprivatefilesink.cpp \
+    ../../xpgenlib/netfile/xpprivateheadworker.cpp \
+    ../../xpgenlib/netfile/xpprivateputworker.cpp
+
+HEADERS  += \
+    xpnethubserver.h \
+    ../../xpgenlib/xpgenlib-mobile_global.h \
+    ../../xpgenlib/netfile/xpnetfile.h \
+    ../../xpgenlib/netfile/xpnetfileview.h \
+    ../../xpgenlib/netfile/xpnetfileutil.h \
+    ../../xpgenlib/netfile/xpgzipdevice.h \
+    ../../xpgenlib/netfile/xpnetbatch.h \
+    ../../xpgenlib/netfile/xpnetcachemanager.h \
+    ../../xpgenlib/netfile/xpnetcachepolicy.h \
+    ../../xpgenlib/netfile/xpnetdelta.h \
+    ../../xpgenlib/netfile/xpnetetagindex.h \
+    ../../xpgenlib/netfile/xpnetmetrics.h \
+    ../../xpgenlib/netfile/xpnetpackstore.h \
+    ../../xpgenlib/netfile/xpnetpool.h \
+    ../../xpgenlib/netfile/xpnetsync.h \
+    ../../xpgenlib/netfile/xpprivategetworker.h \
+    ../../xpgenlib/netfile/xpprivatefilesink.h \
+    ../../xpgenlib/netfile/xpprivateheadworker.h \
+    ../../xpgenlib/netfile/xpprivateputworker.h
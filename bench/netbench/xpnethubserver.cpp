@@ -0,0 +1,425 @@
+// This module implements the local hub stand-in of the XPGENLIB benchmarks.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#include <zlib.h>
+
+#include <QDir>
+#include <QFile>
+#include <QDebug>
+#include <QLocale>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QHostAddress>
+#include <QCryptographicHash>
+
+#include <xpnetdelta.h>
+
+#include "xpnethubserver.h"
+
+// NOTES:
+// 1. Only what XPNetFile uses is implemented: GET, HEAD and PUT with
+//    Content-Length, persistent connections and pipelined requests.
+// 2. The ETag is the quoted MD5 of the content, cached per file until its
+//    size or time changes.
+// 3. A PUT may be gzip encoded or a delta patch with If-Match, the patch
+//    is applied with XPNetDelta::apply() like the hub does. Every
+//    response advertises both so the client uses them.
+// 4. The latency delays each response, the bandwidth cap paces the
+//    response bytes out in XPNETHUBSERVER_PACE_INTERVAL steps.
+// 5. Everything runs on the thread the server lives on, move it to its
+//    own thread to keep it out of the measured code's way.
+//
+
+typedef QPair<QByteArray, QByteArray> Header;
+
+
+//
+// XPNetHubServer
+//
+
+XPNetHubServer::XPNetHubServer(const QString& rootPath, QObject *parent)
+    : QTcpServer(parent), m_rootPath(rootPath), m_webPrefix("/data"), m_latency(0), m_bandwidth(0),
+      m_requestCount(0)
+{
+}
+
+bool XPNetHubServer::start(quint16 port)
+{
+    if (!listen(QHostAddress::LocalHost, port))
+    {
+        qDebug() << "XPNetHubServer::start listen error=" << errorString();
+        return false;
+    }
+
+    qDebug() << "XPNetHubServer::start port=" << serverPort() << "root=" << m_rootPath;
+
+    return true;
+}
+
+void XPNetHubServer::incomingConnection(qintptr socketDescriptor)
+{
+    new XPNetHubConnection(socketDescriptor, this);
+}
+
+QByteArray XPNetHubServer::eTag(const QString& filePath)
+{
+    QFileInfo fi(filePath);
+    if (!fi.isFile())
+        return QByteArray();
+
+    // Hash the content again only when the file changed
+    QString stamp = QString("%1:%2").arg(fi.size()).arg(fi.lastModified().toMSecsSinceEpoch());
+    QHash<QString, QPair<QString, QByteArray> >::const_iterator i = m_eTags.constFind(filePath);
+    if (i != m_eTags.constEnd() && i.value().first == stamp)
+        return i.value().second;
+
+    QFile file(filePath);
+    if (!file.open(QFile::ReadOnly))
+        return QByteArray();
+
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(&file);
+    QByteArray eTag = "\"" + hash.result().toHex() + "\"";
+    m_eTags.insert(filePath, qMakePair(stamp, eTag));
+
+    return eTag;
+}
+
+
+//
+// XPNetHubConnection
+//
+
+XPNetHubConnection::XPNetHubConnection(qintptr socketDescriptor, XPNetHubServer *server)
+    : QObject(server), m_server(server), m_busy(false), m_close(false)
+{
+    m_socket = new QTcpSocket(this);
+    m_socket->setSocketDescriptor(socketDescriptor);
+
+    m_pace.setInterval(XPNETHUBSERVER_PACE_INTERVAL);
+    connect(&m_pace, SIGNAL(timeout()), this, SLOT(onPace()));
+
+    connect(m_socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+    connect(m_socket, SIGNAL(disconnected()), this, SLOT(deleteLater()));
+}
+
+void XPNetHubConnection::onReadyRead()
+{
+    m_in.append(m_socket->readAll());
+    processNext();
+}
+
+void XPNetHubConnection::processNext()
+{
+    // Pipelined requests wait for the one being answered
+    if (m_busy)
+        return;
+
+    int end = m_in.indexOf("\r\n\r\n");
+    if (end < 0)
+        return;
+
+    // Request line and headers
+    QList<QByteArray> lines = m_in.left(end).split('\n');
+    QList<QByteArray> request = lines.value(0).trimmed().split(' ');
+    m_method = request.value(0);
+    m_path = QByteArray::fromPercentEncoding(request.value(1));
+    m_headers.clear();
+    for (int i=1, n=lines.count(); i<n; i++)
+    {
+        int colon = lines.at(i).indexOf(':');
+        if (colon > 0)
+            m_headers.insert(lines.at(i).left(colon).trimmed().toLower(), lines.at(i).mid(colon+1).trimmed());
+    }
+
+    // Wait for the whole body
+    qint64 length = m_headers.value("content-length", "0").toLongLong();
+    if (m_in.size() - (end+4) < length)
+        return;
+
+    m_body = m_in.mid(end+4, length);
+    m_in.remove(0, end+4+length);
+    m_close = (m_headers.value("connection").toLower() == "close");
+    m_busy = true;
+    m_server->countRequest();
+
+    if (m_server->latency() > 0)
+        QTimer::singleShot(m_server->latency(), this, SLOT(onRespond()));
+    else
+        onRespond();
+}
+
+void XPNetHubConnection::onRespond()
+{
+    if (m_method == "GET")
+        handleGet(false);
+    else if (m_method == "HEAD")
+        handleGet(true);
+    else if (m_method == "PUT")
+        handlePut();
+    else
+        respond(405, QList<Header>() << Header("Allow", "GET, HEAD, PUT"), QByteArray());
+}
+
+QString XPNetHubConnection::localPath()
+{
+    QString path = QString::fromUtf8(m_path);
+    int query = path.indexOf('?');
+    if (query >= 0)
+        path.truncate(query);
+
+    // Only the tree below the web prefix is served
+    QString prefix = m_server->webPrefix();
+    if (!path.startsWith(prefix + "/") || path.contains(".."))
+        return QString();
+
+    return m_server->rootPath() + path.mid(prefix.length());
+}
+
+void XPNetHubConnection::handleGet(bool headOnly)
+{
+    QString filePath = localPath();
+    QByteArray eTag = filePath.isEmpty() ? QByteArray() : m_server->eTag(filePath);
+    if (eTag.isEmpty())
+    {
+        respond(404, QList<Header>(), QByteArray("Not found"), headOnly);
+        return;
+    }
+
+    QList<Header> headers;
+    headers << Header("ETag", eTag) << Header("Accept-Ranges", "bytes");
+
+    if (m_headers.value("if-none-match") == eTag)
+    {
+        respond(304, headers, QByteArray(), true);
+        return;
+    }
+
+    QFile file(filePath);
+    if (!file.open(QFile::ReadOnly))
+    {
+        respond(500, QList<Header>(), QByteArray("Unable to read file"), headOnly);
+        return;
+    }
+
+    QFileInfo fi(filePath);
+    headers << Header("Last-Modified", QLocale::c().toString(fi.lastModified().toUTC(),
+                                                             "ddd, dd MMM yyyy hh:mm:ss 'GMT'").toLatin1());
+    qint64 size = file.size();
+
+    // A range of the same version, If-Range falls back to the whole file
+    QByteArray range = m_headers.value("range");
+    QByteArray ifRange = m_headers.value("if-range");
+    if (range.startsWith("bytes=") && (ifRange.isEmpty() || ifRange == eTag))
+    {
+        QList<QByteArray> bounds = range.mid(6).split('-');
+        qint64 start = bounds.value(0).toLongLong();
+        qint64 last = bounds.value(1).isEmpty() ? size-1 : qMin(bounds.value(1).toLongLong(), size-1);
+        if (bounds.count() != 2 || bounds.value(0).isEmpty() || start > last)
+        {
+            headers << Header("Content-Range", QString("bytes */%1").arg(size).toLatin1());
+            respond(416, headers, QByteArray(), headOnly);
+            return;
+        }
+
+        file.seek(start);
+        headers << Header("Content-Range", QString("bytes %1-%2/%3").arg(start).arg(last).arg(size).toLatin1());
+        respond(206, headers, headOnly ? QByteArray() : file.read(last-start+1), headOnly);
+        return;
+    }
+
+    if (headOnly)
+    {
+        // Content-Length of the body a GET would return
+        headers << Header("Content-Length", QByteArray::number(size));
+        respond(200, headers, QByteArray(), true);
+        return;
+    }
+
+    respond(200, headers, file.readAll());
+}
+
+void XPNetHubConnection::handlePut()
+{
+    QString filePath = localPath();
+    if (filePath.isEmpty())
+    {
+        respond(403, QList<Header>(), QByteArray("Forbidden"));
+        return;
+    }
+    if (!m_headers.contains("content-length"))
+    {
+        respond(411, QList<Header>(), QByteArray());
+        return;
+    }
+
+    QByteArray data = m_body;
+    if (m_headers.value("content-encoding") == "gzip" && !gunzip(m_body, &data))
+    {
+        respond(400, QList<Header>(), QByteArray("Bad gzip body"));
+        return;
+    }
+
+    QByteArray current = m_server->eTag(filePath);
+    if (m_headers.value("content-type") == XPNETDELTA_CONTENTTYPE)
+    {
+        // The patch only fits the version it was made against
+        if (current.isEmpty() || m_headers.value("if-match") != current)
+        {
+            respond(412, QList<Header>(), QByteArray());
+            return;
+        }
+
+        QFile base(filePath);
+        base.open(QFile::ReadOnly);
+        bool ok;
+        data = XPNetDelta::apply(base.readAll(), data, &ok);
+        if (!ok)
+        {
+            respond(400, QList<Header>(), QByteArray("Bad patch"));
+            return;
+        }
+    }
+
+    QDir dir;
+    dir.mkpath(QFileInfo(filePath).path());
+    QSaveFile file(filePath);
+    if (!file.open(QFile::WriteOnly) || file.write(data) != data.size() || !file.commit())
+    {
+        respond(500, QList<Header>(), QByteArray("Unable to write file"));
+        return;
+    }
+
+    respond(current.isEmpty() ? 201 : 204, QList<Header>() << Header("ETag", m_server->eTag(filePath)), QByteArray());
+}
+
+void XPNetHubConnection::respond(int status, const QList<Header>& headers, const QByteArray& body, bool headOnly)
+{
+    QByteArray response = "HTTP/1.1 " + QByteArray::number(status) + " " + reason(status) + "\r\n";
+
+    bool hasLength = false;
+    for (int i=0, n=headers.count(); i<n; i++)
+    {
+        response += headers.at(i).first + ": " + headers.at(i).second + "\r\n";
+        hasLength |= (headers.at(i).first == "Content-Length");
+    }
+    if (!hasLength && status != 304)
+        response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+    if (m_close)
+        response += "Connection: close\r\n";
+    response += "Accept-Encoding: gzip\r\n"; // PUT bodies may be gzipped
+    response += "Accept-Patch: " XPNETDELTA_CONTENTTYPE "\r\n";
+    response += "\r\n";
+
+    if (!headOnly)
+        response += body;
+
+    // Send it all now or pace it out under the bandwidth cap
+    if (m_server->bandwidth() <= 0)
+    {
+        m_socket->write(response);
+        finishResponse();
+    }
+    else
+    {
+        m_out = response;
+        onPace();
+        m_pace.start();
+    }
+}
+
+void XPNetHubConnection::onPace()
+{
+    qint64 step = qMax<qint64>(1, m_server->bandwidth()*XPNETHUBSERVER_PACE_INTERVAL/1000);
+
+    m_socket->write(m_out.left(step));
+    m_out.remove(0, qMin<qint64>(step, m_out.size()));
+
+    if (m_out.isEmpty())
+    {
+        m_pace.stop();
+        finishResponse();
+    }
+}
+
+void XPNetHubConnection::finishResponse()
+{
+    m_busy = false;
+
+    if (m_close)
+    {
+        m_socket->disconnectFromHost();
+        return;
+    }
+
+    processNext();
+}
+
+QByteArray XPNetHubConnection::reason(int status)
+{
+    switch (status)
+    {
+    case 200: return "OK";
+    case 201: return "Created";
+    case 204: return "No Content";
+    case 206: return "Partial Content";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 411: return "Length Required";
+    case 412: return "Precondition Failed";
+    case 416: return "Range Not Satisfiable";
+    default: return "Internal Server Error";
+    }
+}
+
+bool XPNetHubConnection::gunzip(const QByteArray& data, QByteArray *result)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, 15+16) != Z_OK)
+        return false;
+
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+    stream.avail_in = data.size();
+
+    result->clear();
+    char buffer[64*1024];
+    int ret;
+    do
+    {
+        stream.next_out = reinterpret_cast<Bytef *>(buffer);
+        stream.avail_out = sizeof(buffer);
+        ret = inflate(&stream, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END)
+            break;
+        result->append(buffer, sizeof(buffer) - stream.avail_out);
+    }
+    while (ret != Z_STREAM_END);
+
+    inflateEnd(&stream);
+
+    return ret == Z_STREAM_END;
+}
+
+// End of file
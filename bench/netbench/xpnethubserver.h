@@ -0,0 +1,127 @@
+// This module defines the local hub stand-in of the XPGENLIB benchmarks.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#ifndef XPNETHUBSERVER_H
+#define XPNETHUBSERVER_H
+
+#include <QHash>
+#include <QPair>
+#include <QTimer>
+#include <QString>
+#include <QByteArray>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#define XPNETHUBSERVER_PACE_INTERVAL 10 // msecs between paced writes
+
+class XPNetHubServer;
+
+
+/*
+ * Minimal HTTP/1.1 server standing in for a hub's web server: serves
+ * and stores files below a root directory with ETags, 304s, ranges,
+ * gzip and delta PUTs, optional latency and bandwidth limits
+ */
+
+class XPNetHubServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    explicit XPNetHubServer(const QString& rootPath, QObject *parent = 0);
+
+    // Delay before every response and cap on the bytes sent per second
+    void setLatency(int msecs) { m_latency = msecs; }
+    void setBandwidth(qint64 bytesPerSecond) { m_bandwidth = bytesPerSecond; }
+    int latency() { return m_latency; }
+    qint64 bandwidth() { return m_bandwidth; }
+
+    // URL path prefix of the served tree, XPNetFile adds "/data"
+    void setWebPrefix(const QString& prefix) { m_webPrefix = prefix; }
+    QString webPrefix() { return m_webPrefix; }
+
+    QString rootPath() { return m_rootPath; }
+    quint64 requestCount() { return m_requestCount; }
+
+    // ETag of the file's current content, empty if there is no file
+    QByteArray eTag(const QString& filePath);
+    void countRequest() { m_requestCount++; }
+
+public slots:
+    // Listen on the loopback interface, port 0 picks a free one
+    bool start(quint16 port = 0);
+
+protected:
+    virtual void incomingConnection(qintptr socketDescriptor);
+
+private:
+    QString m_rootPath;
+    QString m_webPrefix;
+    int m_latency;
+    qint64 m_bandwidth;
+    quint64 m_requestCount;
+    QHash<QString, QPair<QString, QByteArray> > m_eTags; // path, (size and time, ETag)
+};
+
+
+/*
+ * One client connection, requests are answered in order
+ */
+
+class XPNetHubConnection : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit XPNetHubConnection(qintptr socketDescriptor, XPNetHubServer *server);
+
+private slots:
+    void onReadyRead();
+    void onRespond();
+    void onPace();
+
+private:
+    void processNext();
+    void handleGet(bool headOnly);
+    void handlePut();
+    void respond(int status, const QList<QPair<QByteArray, QByteArray> >& headers,
+                 const QByteArray& body, bool headOnly = false);
+    void finishResponse();
+    QString localPath();
+    static QByteArray reason(int status);
+    static bool gunzip(const QByteArray& data, QByteArray *result);
+
+private:
+    XPNetHubServer *m_server;
+    QTcpSocket *m_socket;
+    QByteArray m_in;
+    bool m_busy; // a request is being answered
+    //
+    QByteArray m_method;
+    QByteArray m_path;
+    QHash<QByteArray, QByteArray> m_headers; // lower case names
+    QByteArray m_body;
+    bool m_close;
+    //
+    QByteArray m_out; // response bytes still to be paced out
+    QTimer m_pace;
+};
+
+#endif // XPNETHUBSERVER_H
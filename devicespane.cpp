@@ -29,7 +29,7 @@
 
 
 DevicesPane::DevicesPane(QWidget *parent) :
-    QWidget(parent)
+    QWidget(parent), m_updating(false), m_updatePending(false), m_clearCount(0)
 {
     // Save the RML cache path
     QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
@@ -51,16 +51,59 @@ DevicesPane::DevicesPane(QWidget *parent) :
 
 void DevicesPane::clear()
 {
+    // The items the probes would update are going
+    qDeleteAll(m_probes.keys());
+    m_probes.clear();
+
     m_outline->clear();
+    m_clearCount++;
 }
 
 void DevicesPane::update(QString &hostAddress, QString &hostName, const QMap<QString, QString> &world)
+{
+    // Fetching from the hub runs nested event loops, an update asked for
+    // meanwhile is kept and run once the current one returns
+    if (m_updating)
+    {
+        m_pendingHostAddress = hostAddress;
+        m_pendingHostName = hostName;
+        m_pendingWorld = world;
+        m_updatePending = true;
+        return;
+    }
+
+    m_updating = true;
+    build(hostAddress, hostName, world);
+    while (m_updatePending)
+    {
+        m_updatePending = false;
+        build(m_pendingHostAddress, m_pendingHostName, m_pendingWorld);
+    }
+    m_updating = false;
+}
+
+void DevicesPane::build(const QString &hostAddress, const QString &hostName, const QMap<QString, QString> &world)
 {
     clear();
+    int clearCount = m_clearCount;
 
     // Set up for category actions
     XPCategory category(m_rmlCachePath, hostAddress);
 
+    // Fetch what the devices need from the hub in one batch
+    QList<QPair<QString, QString> > models;
+    foreach (const QString& value, world)
+    {
+        QStringList values = value.split(";", QString::SkipEmptyParts); // ouid;nick;manf;mmod;file1;...filen;
+        if (values.count() >= 5)
+            models.append(qMakePair(values.at(2), values.at(3)));
+    }
+    QHash<QPair<QString, QString>, QString> categories = category.prefetch(models, 72);
+
+    // Superseded or cleared while waiting for the hub
+    if (m_updatePending || clearCount != m_clearCount)
+        return;
+
     // Hub level node
     m_outline->insertTopLevelItem(0, new QTreeWidgetItem((QTreeWidget*)0, QStringList(hostName+" - hub"), DEV_TYPE_HUB));
     QFont f = m_outline->topLevelItem(0)->font(0);
@@ -81,12 +124,17 @@ void DevicesPane::update(QString &hostAddress, QString &hostName, const QMap<QSt
             // Add device level node
             QString nickname = values.at(1);
             QTreeWidgetItem *deviceItem = new QTreeWidgetItem((QTreeWidget*)0, QStringList(nickname), DEV_TYPE_DEVICE);
-            QString catcode = category.getCategory(values.at(2), values.at(3));
+            QString catcode = categories.value(qMakePair(values.at(2), values.at(3)));
             if (catcode.isEmpty())
                 deviceItem->setIcon(0, QIcon(":/images/download.png"));
             else // got the category
             {
                 QIcon icon = category.getIcon(catcode, 72);
+                if (m_updatePending || clearCount != m_clearCount)
+                {
+                    delete deviceItem;
+                    return;
+                }
                 if (icon.isNull())  // index file missing
                 {
                     clear();
@@ -117,11 +165,21 @@ void DevicesPane::update(QString &hostAddress, QString &hostName, const QMap<QSt
                         .arg(values.at(3))
                         .arg(values.at(i));
 
-                // Display appropriate icon
-                if (!QFile::exists(fileName))
-                    fileItem->setIcon(0, QIcon(":/images/document-close.svg"));
-                else
+                // Display appropriate icon, a HEAD request tells whether
+                // a file not cached is on the hub without fetching it
+                if (QFile::exists(fileName))
                     fileItem->setIcon(0, QIcon(":/images/file.png"));
+                else
+                {
+                    fileItem->setIcon(0, QIcon(":/images/document-close.svg"));
+
+                    QUrl url = QUrl(QString("http://%1/profiles/%2/%3/%4").arg(hostAddress)
+                                    .arg(values.at(2)).arg(values.at(3)).arg(values.at(i)));
+                    XPNetFile *probe = new XPNetFile(url, fileName, this);
+                    connect(probe, SIGNAL(finished(bool)), this, SLOT(onProbeFinished(bool)));
+                    m_probes.insert(probe, fileItem);
+                    probe->statAsync();
+                }
                 fileItem->setData(0, Qt::UserRole, deviceId);
                 deviceItem->addChild(fileItem);
             }
@@ -155,4 +213,15 @@ void DevicesPane::onItemClicked(QTreeWidgetItem *item, int column)
     }
 }
 
+void DevicesPane::onProbeFinished(bool ok)
+{
+    XPNetFile *probe = qobject_cast<XPNetFile *>(sender());
+    QTreeWidgetItem *fileItem = m_probes.take(probe);
+    probe->deleteLater();
+
+    // On the hub, fetched when opened
+    if (fileItem && ok)
+        fileItem->setIcon(0, QIcon(":/images/download.png"));
+}
+
 // end of file
@@ -21,9 +21,13 @@
 #ifndef DEVICESPANE_H
 #define DEVICESPANE_H
 
+#include <QMap>
+#include <QHash>
 #include <QWidget>
 #include <QTreeWidget>
 
+#include <xpnetfile.h>
+
 // Define the item types.
 //
 #define DEV_TYPE_HUB 1
@@ -57,12 +61,24 @@ public:
 
 protected slots:
     void onItemClicked(QTreeWidgetItem *item, int column);
+    void onProbeFinished(bool ok);
+
+private:
+    void build(const QString& hostAddress, const QString& hostName, const QMap<QString, QString>& world);
 
 private:
     QTreeWidget *m_outline;
+    QHash<XPNetFile *, QTreeWidgetItem *> m_probes; // hub checks of files not cached
     QString m_device;
     QString m_filename;
     QString m_rmlCachePath;
+    //
+    bool m_updating; // in update(), maybe waiting for the hub
+    bool m_updatePending;
+    int m_clearCount;
+    QString m_pendingHostAddress;
+    QString m_pendingHostName;
+    QMap<QString, QString> m_pendingWorld;
 };
 
 #endif // DEVICESPANE_H
@@ -55,7 +55,8 @@ INCLUDEPATH += \
     ./xpgenlib/adrcproxy
 
 LIBS += \
-    -lqscintilla2
+    -lqscintilla2 \
+    -lz
 
 SOURCES += main.cpp \
     mainwindow.cpp \
@@ -68,11 +69,28 @@ SOURCES += main.cpp \
     xpgenlib/xpnetservicewatcher.cpp \
     xpgenlib/xpunitfile.cpp \
     xpgenlib/netfile/xpnetfile.cpp \
+    xpgenlib/netfile/xpnetfileview.cpp \
+    xpgenlib/netfile/xpnetfileutil.cpp \
+    xpgenlib/netfile/xpgzipdevice.cpp \
+    xpgenlib/netfile/xpnetbatch.cpp \
+    xpgenlib/netfile/xpnetcachemanager.cpp \
+    xpgenlib/netfile/xpnetcachepolicy.cpp \
+    xpgenlib/netfile/xpnetdelta.cpp \
+    xpgenlib/netfile/xpnetetagindex.cpp \
+    xpgenlib/netfile/xpnetmetrics.cpp \
+    xpgenlib/netfile/xpnetpackstore.cpp \
+    xpgenlib/netfile/xpnetpool.cpp \
+    xpgenlib/netfile/xpnetsync.cpp \
     xpgenlib/netfile/xpprivategetworker.cpp \
+    xpgenlib/netfile/xpprivatefilesink.cpp \
+    xpgenlib/netfile/xpprivateheadworker.cpp \
     xpgenlib/netfile/xpprivateputworker.cpp \
     xpgenlib/adrcproxy/xpadrctcpproxy.cpp \
-    xpgenlib/adrcproxy/executethread.cpp \
-    xpgenlib/adrcproxy/signalthread.cpp \
+    xpgenlib/adrcproxy/xpadrcreply.cpp \
+    xpgenlib/adrcproxy/executechannel.cpp \
+    xpgenlib/adrcproxy/signalchannel.cpp \
+    xpgenlib/adrcproxy/xpadrciothread.cpp \
+    xpgenlib/adrcproxy/xpadrccodec.cpp \
     settingsdialog.cpp
 
 HEADERS  += \
@@ -86,11 +104,28 @@ HEADERS  += \
     xpgenlib/xpnetservicewatcher.h \
     xpgenlib/xpunitfile.h \
     xpgenlib/netfile/xpnetfile.h \
+    xpgenlib/netfile/xpnetfileview.h \
+    xpgenlib/netfile/xpnetfileutil.h \
+    xpgenlib/netfile/xpgzipdevice.h \
+    xpgenlib/netfile/xpnetbatch.h \
+    xpgenlib/netfile/xpnetcachemanager.h \
+    xpgenlib/netfile/xpnetcachepolicy.h \
+    xpgenlib/netfile/xpnetdelta.h \
+    xpgenlib/netfile/xpnetetagindex.h \
+    xpgenlib/netfile/xpnetmetrics.h \
+    xpgenlib/netfile/xpnetpackstore.h \
+    xpgenlib/netfile/xpnetpool.h \
+    xpgenlib/netfile/xpnetsync.h \
     xpgenlib/netfile/xpprivategetworker.h \
+    xpgenlib/netfile/xpprivatefilesink.h \
+    xpgenlib/netfile/xpprivateheadworker.h \
     xpgenlib/netfile/xpprivateputworker.h \
     xpgenlib/adrcproxy/xpadrctcpproxy.h \
-    xpgenlib/adrcproxy/executethread.h \
-    xpgenlib/adrcproxy/signalthread.h \
+    xpgenlib/adrcproxy/xpadrcreply.h \
+    xpgenlib/adrcproxy/executechannel.h \
+    xpgenlib/adrcproxy/signalchannel.h \
+    xpgenlib/adrcproxy/xpadrciothread.h \
+    xpgenlib/adrcproxy/xpadrccodec.h \
     settingsdialog.h
 
 RESOURCES += \
@@ -22,11 +22,16 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QSettings>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QPushButton>
 #include <QVBoxLayout>
 #include <QXmlStreamReader>
 #include <QProcessEnvironment>
 
 #include <xpnetfile.h>
+#include <xpgzipdevice.h>
+#include <xpnetmetrics.h>
 #include <xpcategory.h>
 
 #include "explorerpane.h"
@@ -42,6 +47,7 @@ ExplorerPane::ExplorerPane(QWidget *parent) :
     metadataPage = createMetadataPage();
     errorsPage = createErrorsPage();
     outputPage = createOutputPage();
+    networkPage = createNetworkPage();
 
     // Create the tab widget
     tabWidget = new QTabWidget;
@@ -50,6 +56,7 @@ ExplorerPane::ExplorerPane(QWidget *parent) :
     tabWidget->addTab(metadataPage, "Metadata");
     tabWidget->addTab(errorsPage, "Errors");
     tabWidget->addTab(outputPage, "Simulator");
+    tabWidget->addTab(networkPage, "Network");
 
     // Create the main layout
     QVBoxLayout *layout = new QVBoxLayout;
@@ -60,7 +67,12 @@ ExplorerPane::ExplorerPane(QWidget *parent) :
     setLayout(layout);
 
     // Connect signals
-    //connect(tabWidget, SIGNAL(currentChanged(int)), this, SLOT(onTabChanged(int)));
+    connect(tabWidget, SIGNAL(currentChanged(int)), this, SLOT(onTabChanged(int)));
+
+    // Refresh the network figures while they are shown, see setNetworkPolling()
+    networkTimer = new QTimer(this);
+    networkTimer->setInterval(2000);
+    connect(networkTimer, SIGNAL(timeout()), this, SLOT(updateNetwork()));
 
     clear();
 }
@@ -140,6 +152,34 @@ QWidget *ExplorerPane::createMetadataPage()
     return page;
 }
 
+QWidget *ExplorerPane::createNetworkPage()
+{
+    QWidget *page = new QWidget;
+
+    networkText = new QTextEdit;
+    networkText->setReadOnly(true);
+    networkText->setLineWrapMode(QTextEdit::NoWrap);
+    networkText->setTabStopWidth(80);
+
+    QPushButton *exportButton = new QPushButton(tr("Export JSON..."));
+    connect(exportButton, SIGNAL(clicked()), this, SLOT(onNetworkExport()));
+
+    // Create the main layout
+    //
+    QHBoxLayout *buttonLayout = new QHBoxLayout;
+    buttonLayout->addStretch(1);
+    buttonLayout->addWidget(exportButton);
+    //
+    QVBoxLayout *layout = new QVBoxLayout;
+    layout->setContentsMargins(0,0,0,0);
+    layout->addWidget(networkText);
+    layout->addLayout(buttonLayout);
+    //
+    page->setLayout(layout);
+
+    return page;
+}
+
 void ExplorerPane::clear()
 {
     clearMetadata();
@@ -221,9 +261,7 @@ void ExplorerPane::updateMetadata(const QString &rml, const QString &uri, const
     // Update the RML file information
     labelFileName->setText(QString("File:\t%1").arg(uri));
     labelFileSize->setText(QString("Size:\t%1").arg(rml.length()));
-    // >>> KLUDGE Actually gZip the file and get the correct size
-    labelFileZsize->setText(QString("Zip size:\t%1").arg(rml.length()/2)); //TODO gzip file and get size
-    // <<< KLUDGE Actually gZip the file and get the correct size
+    labelFileZsize->setText(QString("Zip size:\t%1").arg(XPGzipDevice::compress(rml.toUtf8()).size()));
 }
 
 void ExplorerPane::updateErrors(const QString& errors)
@@ -263,4 +301,56 @@ void ExplorerPane::updateOutput(const QString& output)
     }
 }
 
+void ExplorerPane::updateNetwork()
+{
+    // Nothing to do while the page is hidden
+    if (tabWidget->currentWidget() != networkPage || !isVisible())
+        return;
+
+    networkText->setPlainText(XPNetMetrics::instance()->summary());
+}
+
+void ExplorerPane::onTabChanged(int index)
+{
+    setNetworkPolling(isVisible() && tabWidget->widget(index) == networkPage);
+}
+
+void ExplorerPane::showEvent(QShowEvent *event)
+{
+    QWidget::showEvent(event);
+    setNetworkPolling(tabWidget->currentWidget() == networkPage);
+}
+
+void ExplorerPane::hideEvent(QHideEvent *event)
+{
+    QWidget::hideEvent(event);
+    setNetworkPolling(false);
+}
+
+void ExplorerPane::setNetworkPolling(bool on)
+{
+    if (!on)
+    {
+        networkTimer->stop();
+        return;
+    }
+
+    // Show the figures at once, then keep them fresh
+    if (!networkTimer->isActive())
+        networkTimer->start();
+    networkText->setPlainText(XPNetMetrics::instance()->summary());
+}
+
+void ExplorerPane::onNetworkExport()
+{
+    QString filePath = QFileDialog::getSaveFileName(this, tr("Export Network Metrics"),
+                                                    QDir::homePath()+"/xpnetmetrics.json",
+                                                    tr("JSON files (*.json)"));
+    if (filePath.isEmpty())
+        return;
+
+    if (!XPNetMetrics::instance()->exportJson(filePath))
+        QMessageBox::warning(this, tr("Export Network Metrics"), tr("Unable to write %1").arg(filePath));
+}
+
 // End of file
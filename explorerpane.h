@@ -21,6 +21,7 @@
 #ifndef EXPLORERPANE_H
 #define EXPLORERPANE_H
 
+#include <QTimer>
 #include <QWidget>
 #include <QTextEdit>
 #include <QTabWidget>
@@ -43,17 +44,28 @@ public slots:
     void updateOutput(const QString& output);
     void updateErrors(const QString& errors);
     void updateMetadata(const QString& rml, const QString& uri, const QString& hostAddress);
+    void updateNetwork();
+
+private slots:
+    void onTabChanged(int index);
+    void onNetworkExport();
 
 protected:
+    virtual void showEvent(QShowEvent *event);
+    virtual void hideEvent(QHideEvent *event);
+    //
+    void setNetworkPolling(bool on);
     QWidget *createOutputPage();
     QWidget *createErrorsPage();
     QWidget *createMetadataPage();
+    QWidget *createNetworkPage();
 
 private: // data
     QTabWidget *tabWidget;
     QWidget *outputPage;
     QWidget *errorsPage;
     QWidget *metadataPage;
+    QWidget *networkPage;
     QString rmlCachePath;
 
     // Metadata page contents
@@ -64,6 +76,10 @@ private: // data
     QLabel *labelFileName;
     QLabel *labelFileSize;
     QLabel *labelFileZsize; // compressed size
+
+    // Network page contents
+    QTextEdit *networkText;
+    QTimer *networkTimer;
 };
 
 #endif // EXPLORERPANE_H
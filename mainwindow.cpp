@@ -44,6 +44,8 @@
 
 #include <xpnetfile.h>
 #include <xpunitfile.h>
+#include <xpnetcachepolicy.h>
+#include <xpnetcachemanager.h>
 #include <xpnetservicewatcher.h>
 
 #include "rmltransferdialog.h"
@@ -65,7 +67,7 @@
 
 
 MainWindow::MainWindow(QWidget *parent)
-    : QMainWindow(parent), editPane(0), proxy(0), editTabWidget(0)
+    : QMainWindow(parent), editPane(0), proxy(0), worldReply(0), profileSync(0), editTabWidget(0)
 {
     setMinimumSize(800, 640);
     setWindowTitle(tr(WINDOW_TITLE) + tr(" - Searching for hub"));
@@ -193,6 +195,10 @@ void MainWindow::createEditor(const QString& filePath)
 
     editTabFilePaths[editPane] = tabFilePath;
     editTabWidget->setCurrentIndex(index);
+
+    // Keep a cached file out of eviction while it is being edited
+    if (tabFilePath != RMLIDE_EMPTY_FILEPATH)
+        XPNetCacheManager::instance()->pin(tabFilePath);
 }
 
 void MainWindow::createActions()
@@ -519,6 +525,7 @@ void MainWindow::closeFile()
     int index = editTabWidget->indexOf(editPane);
 
     // Remove the editTabFilePath
+    XPNetCacheManager::instance()->unpin(editTabFilePaths[editPane]);
     editTabFilePaths.remove(editPane);
 
     // Delete the tab
@@ -776,48 +783,31 @@ bool MainWindow::uploadToDevice(QString fileName,
 
     // (1) Send RML to remote host
     //
-    // Generate a temp file name for the RML
+    // Generate a unique upload name for the RML
     QUuid uuid = QUuid::createUuid();
     QString tmpFilename = QString("%1.tmp").arg(uuid.toString());
     // get rid off leading { and trailing }
     tmpFilename.remove('{');
     tmpFilename.remove('}');
 
-    // Transfer local RML file to host upload location using XPNetFile
+    // Transfer RML to host upload location using XPNetFile
     QUrl url = QUrl(QString("http://%1/uploads/%2").arg(hostAddress).arg(tmpFilename));
     //url.setUserName("anonymous");
     //url.setPassword("none");
 
-    XPNetFile rmlFile(url, QString("/tmp/%1").arg(tmpFilename));
-    if (!rmlFile.open(QFile::WriteOnly))
-    {
-        QMessageBox::warning(this, tr("Upload RML"),
-            tr("Failed to open local RML temp file for writing"),
-            QMessageBox::Close);
-        return false;
-    }
-
     QString rml = editPane->text();
 
-    if (rmlFile.write(rml.toLatin1()) != rml.size())
+    // Send the RML straight from memory
+    XPNetFile rmlFile(url, QString());
+    rmlFile.setPriority(XPNetPool::Interactive);
+    if (!rmlFile.put(rml.toLatin1()))
     {
         QMessageBox::warning(this, tr("Upload RML"),
-            tr("Failed to write RML data to local temp file"),
+            tr("Failed to transfer RML to remote host"),
             QMessageBox::Close);
         return false;
     }
 
-    if (!rmlFile.close()) // this initiates the file transfer
-    {
-        QMessageBox::warning(this, tr("Upload RML"),
-            tr("Failed to transfer RML temp file to remote host"),
-            QMessageBox::Close);
-        return false;
-    }
-
-    // Delete the local file
-    rmlFile.remove();
-
     // (2) Ask remote host to send RML file to the device#if 1
     //
     QString oxml = rcp.arg(deviceId).arg(tmpFilename).arg(fileName);
@@ -825,6 +815,10 @@ bool MainWindow::uploadToDevice(QString fileName,
     // Execute the file transfer
     forever
     {
+        // The hub may have gone while a dialog was up
+        if (proxy == 0)
+            return false;
+
         QString ixml = proxy->Execute(oxml);
 
         if (ixml.contains("<ack"))
@@ -855,46 +849,29 @@ bool MainWindow::uploadToDevice(QString fileName,
         return false;
     }
 
-    // Generate a temp file name for the UNIT data
+    // Generate a unique upload name for the UNIT data
     uuid = QUuid::createUuid();
     tmpFilename = QString("%1.tmp").arg(uuid.toString());
     // get rid off leading { and trailing }
     tmpFilename.remove('{');
     tmpFilename.remove('}');
 
-    // Transfer local UNIT file to host using XPNetFile
+    // Transfer UNIT data to host upload location using XPNetFile
     url = QUrl(QString("http://%1/uploads/%2").arg(hostAddress).arg(tmpFilename));
     //url.setUserName("anonymous");
     //url.setPassword("none");
 
-    XPNetFile unitFile(url, QString("/tmp/%1").arg(tmpFilename));
-    if (!unitFile.open(QFile::WriteOnly))
+    // Send the UNIT data straight from memory
+    XPNetFile unitFile(url, QString());
+    unitFile.setPriority(XPNetPool::Interactive);
+    if (!unitFile.put(QByteArray(unit.data(), unit.size())))
     {
         QMessageBox::warning(this, tr("Upload RML"),
-            tr("Failed to open local UNIT temp file for writing"),
+            tr("Failed to transfer UNIT data to remote host"),
             QMessageBox::Close);
         return false;
     }
 
-    if (unitFile.write(unit.data(), unit.size()) != unit.size())
-    {
-        QMessageBox::warning(this, tr("Upload RML"),
-            tr("Failed to write UNIT data to local temp file"),
-            QMessageBox::Close);
-        return false;
-    }
-
-    if (!unitFile.close()) // this initiates the file transfer
-    {
-        QMessageBox::warning(this, tr("Upload RML"),
-            tr("Failed to transfer UNIT temp file to remote host"),
-            QMessageBox::Close);
-        return false;
-    }
-
-    // Delete the local file
-    unitFile.remove();
-
     // (4) Ask remote host to send UNIT file to the device
     //
     oxml = rcp.arg(deviceId).arg(tmpFilename).arg("unit");
@@ -902,6 +879,10 @@ bool MainWindow::uploadToDevice(QString fileName,
     // Execute the file transfer
     forever
     {
+        // The hub may have gone while a dialog was up
+        if (proxy == 0)
+            return false;
+
         QString ixml = proxy->Execute(oxml);
 
         if (ixml.contains("<ack"))
@@ -954,6 +935,7 @@ bool MainWindow::uploadToCache(QString manf,
     //url.setPassword("none");
 
     XPNetFile rmlFile(url, tmpFilename);
+    rmlFile.setPriority(XPNetPool::Interactive);
     if (!rmlFile.open(QFile::WriteOnly))
     {
         QMessageBox::warning(this, tr("Upload RML"),
@@ -1003,6 +985,7 @@ bool MainWindow::uploadToCache(QString manf,
     //url.setPassword("none");
 
     XPNetFile unitFile(url, tmpFilename);
+    unitFile.setPriority(XPNetPool::Interactive);
     if (!unitFile.open(QFile::WriteOnly))
     {
         QMessageBox::warning(this, tr("Upload RML"),
@@ -1137,6 +1120,10 @@ QString MainWindow::downloadFromDevice(QString manf,
         // Execute the file transfer
         forever
         {
+            // The hub may have gone while a dialog was up
+            if (proxy == 0)
+                return QString();
+
             QString ixml = proxy->Execute(oxml);
 
             if (ixml.contains("<ack"))
@@ -1148,6 +1135,8 @@ QString MainWindow::downloadFromDevice(QString manf,
 
                 // Save file to local directory
                 XPNetFile file(url, localFilename);
+                file.setPriority(XPNetPool::Interactive);
+                file.invalidate(); // the device has just copied it to the hub
                 if (file.exists())
                     break;
                 else // transfer failed
@@ -1192,6 +1181,10 @@ QString MainWindow::downloadFromDevice(QString manf,
         // Execute the file transfer
         forever
         {
+            // The hub may have gone while a dialog was up
+            if (proxy == 0)
+                return QString();
+
             QString ixml = proxy->Execute(oxml);
 
             if (ixml.contains("<ack"))
@@ -1203,6 +1196,8 @@ QString MainWindow::downloadFromDevice(QString manf,
 
                 // Save file to local directory
                 XPNetFile file(url, localFilename);
+                file.setPriority(XPNetPool::Interactive);
+                file.invalidate(); // the device has just copied it to the hub
                 if (file.exists())
                     break;
                 else // transfer failed
@@ -1268,6 +1263,8 @@ QString MainWindow::downloadFromCache(QString manf,
 
             // Save file to local cache directory
             XPNetFile file(url, localFilename);
+            file.setPriority(XPNetPool::Interactive);
+            file.invalidate(); // asked for by the user, check with the hub
             if( file.exists())
                 break;
             else // transfer failed
@@ -1304,6 +1301,8 @@ QString MainWindow::downloadFromCache(QString manf,
 
             // Save file to local cache directory
             XPNetFile file(url, localFilename);
+            file.setPriority(XPNetPool::Interactive);
+            file.invalidate(); // asked for by the user, check with the hub
             if(file.exists())
                 break;
             else // transfer failed
@@ -1597,6 +1596,8 @@ bool MainWindow::writeFile(const QString& filePath)
         editTabWidget->setTabText(index, fi.fileName());
 
         // Change the editTabFilePath
+        XPNetCacheManager::instance()->unpin(tabFilePath);
+        XPNetCacheManager::instance()->pin(filePath);
         editTabFilePaths[editPane] = filePath;
     }
 
@@ -1654,28 +1655,68 @@ void MainWindow::onProxyOnline(bool online)
         return;
     }
 
-    // Network is online
+    // Network is online, cached hub files are checked again
+    XPNetCachePolicy::instance()->invalidate();
     QString hostAddress = proxy->getHostAddress();
     setWindowTitle(tr(WINDOW_TITLE));
     statusMode->setText(QString("Hub: on-line@%1").arg(hostAddress));
 
-    // Update the world from the hub
+    // Update the world from the hub, the devices pane follows the reply
     updateWorld();
 
+    // Bring the cached profiles up to date in one pass behind it
+    if (profileSync)
+        delete profileSync;
+    profileSync = new XPNetSync(hostAddress, rmlCachePath, this);
+    connect(profileSync, SIGNAL(finished(bool)), this, SLOT(onProfileSyncFinished(bool)));
+    profileSync->start();
+
     // Update the views
     QString rml = editPane->text();
     QString uri = editTabFilePaths[editPane];
     if (!uri.isEmpty() && !rml.isEmpty())
         explorerPane->updateMetadata(rml, uri, hostAddress);
-    devicesPane->update(hostAddress, hubName, world);
+}
+
+void MainWindow::onProfileSyncFinished(bool ok)
+{
+    if (!ok)
+        qDebug() << "MainWindow::onProfileSyncFinished profile sync error=" << profileSync->errorString();
+
+    int changed = profileSync->changedCount();
+    profileSync->deleteLater();
+    profileSync = 0;
+
+    // Show the profiles that came in since the world was drawn
+    if (changed > 0 && proxy && !world.isEmpty())
+        devicesPane->update(proxy->getHostAddress(), hubName, world);
 }
 
 void MainWindow::updateWorld()
 {
-    // Query the ADRC daemon for all devices
+    // The hub may have gone meanwhile
+    if (proxy == 0)
+        return;
+
+    // Only the latest list matters, drop one still in flight
+    if (worldReply)
+    {
+        worldReply->disconnect(this);
+        delete worldReply;
+    }
+
+    // Query the ADRC daemon for all devices, the UI carries on while the hub answers
     //
     QString inxml = QString("<adrc><device id='*'><exec>list</exec></device></adrc>");
-    QString outxml = proxy->Execute(inxml);
+    worldReply = proxy->ExecuteAsync(inxml, 5000, this);
+    connect(worldReply, SIGNAL(finished(QString)), this, SLOT(onWorldReply(QString)));
+}
+
+void MainWindow::onWorldReply(QString outxml)
+{
+    worldReply->deleteLater();
+    worldReply = 0;
+
     if (outxml.isEmpty())
     {
         qDebug() << "MainWindow::onNetworkOnline proxy execute failed";
@@ -1757,6 +1798,10 @@ void MainWindow::updateWorld()
             fsWatcher->addPath(QString("%1/profiles/%2/%3").arg(rmlCachePath).arg(manf).arg(mmod));
         }
     }
+
+    // Update the devices pane
+    if (proxy)
+        devicesPane->update(proxy->getHostAddress(), hubName, world);
 }
 
 void MainWindow::updateStatusBar()
@@ -1943,12 +1988,11 @@ void MainWindow::onDeviceEvent(QString sigxml)
     if (proxy == 0 || !proxy->isValid())
         return;
 
-    // Update the world from the hub
-    updateWorld();
+    // Devices may have come with new profiles, look for missing files again
+    XPNetCachePolicy::instance()->clearMissing();
 
-    // Update the devices pane
-    QString hostAddress = proxy->getHostAddress();
-    devicesPane->update(hostAddress, hubName, world);
+    // Update the world and then the devices pane from the hub
+    updateWorld();
 }
 
 bool MainWindow::validateManfMmodel(QString& rml)
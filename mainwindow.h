@@ -36,6 +36,8 @@
 #include <xpadrctcpproxy.h>
 #include <Qsci/qsciscintilla.h>
 
+#include <xpnetsync.h>
+
 #include "devicespane.h"
 #include "explorerpane.h"
 
@@ -104,6 +106,8 @@ private slots:
     void onTabCloseRequested(int index);
     //
     void onDeviceEvent(QString sigxml);
+    void onWorldReply(QString outxml);
+    void onProfileSyncFinished(bool ok);
 
 private:
     void createEditor(const QString& filePath);
@@ -191,6 +195,8 @@ private:
     QLabel *statusMode;
     //
     AdrcTcpProxy *proxy;
+    AdrcReply *worldReply; // device list request in flight
+    XPNetSync *profileSync; // cached profiles being brought up to date
     QMap<QString, QString> world;
     QString rmlCachePath;
     QString hubName;
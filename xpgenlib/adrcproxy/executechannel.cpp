@@ -0,0 +1,552 @@
+// This module implements the execute channel of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later 
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#include <QDebug>
+#include <QRegExp>
+#include <QAtomicInt>
+#include <QHostAddress>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+
+#include "executechannel.h"
+#include "xpadrciothread.h"
+
+// NOTES:
+// 1. Requests are pipelined: each one gets a correlation id and is sent
+//    without waiting for the replies still outstanding. Once the hello
+//    has agreed on version 2 the id goes out too, as a cid attribute of
+//    the root element. Whether the old daemon accepts an unknown
+//    attribute is not known, so version 1 requests go unchanged.
+// 2. A reply carrying a cid goes to that request, whatever the order.
+//    Hubs that don't echo the id answer in order, so a reply without
+//    one goes to the oldest request in flight.
+// 3. Each waited for request has its own mailbox: the reply is put in
+//    and its caller woken the moment the frame is decoded, whether the
+//    caller is already waiting or comes for it later. A caller that
+//    timed out gets nothing stale later, its reply is dropped.
+// 4. Requests in flight when the connection drops, or written to a host
+//    that can't be reached, fail straight away with an empty reply.
+// 5. The socket lives on the AdrcIoThread: a new request is a queued
+//    call to onSend(), replies come in with readyRead(). The connection
+//    is made when the first request is sent and again after a drop.
+// 6. Notified replies are emitted from the I/O thread, connect to them
+//    with a queued connection.
+// 7. Every connection starts with the AdrcCodec hello. Requests are
+//    held back until it is answered, or ADRCCODEC_HELLO_MSECS have gone
+//    by, and then go out in the framing agreed on. A late answer can't
+//    be told from a reply, so a hello that times out drops the
+//    connection and the requests go on a new one without a hello, as
+//    do all later connections to that hub.
+//
+
+// Ids stay unique across channels, a late reply can't match a new request
+static QAtomicInt nextRequestId;
+
+// Hubs that left the hello unanswered, "address:port", I/O thread only
+static QSet<QString> silentHubs;
+
+// Index of the '<' of the root element, -1 if there is none
+static int rootElement(const QString& xml)
+{
+    int i = 0;
+
+    forever
+    {
+        i = xml.indexOf('<', i);
+        if (i < 0 || i+1 >= xml.size())
+            return -1;
+
+        // Skip the XML declaration, comments and the like
+        QChar c = xml.at(i+1);
+        if (c != '?' && c != '!')
+            return i;
+        i++;
+    }
+}
+
+
+ExecuteChannel::ExecuteChannel(const QString& address, quint16 port)
+    : QObject(0), m_closed(false), m_orphaned(false), m_waiters(0), m_sendQueued(false),
+      m_address(address), m_port(port), m_wasConnected(false),
+      m_helloId(0), m_negotiating(false)
+{
+    // Children move to the I/O thread with the channel
+    m_socket = new QTcpSocket(this);
+    m_connectTimer = new QTimer(this);
+    m_connectTimer->setSingleShot(true);
+    m_helloTimer = new QTimer(this);
+    m_helloTimer->setSingleShot(true);
+
+    connect(m_socket, SIGNAL(connected()), this, SLOT(onConnected()));
+    connect(m_socket, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+    connect(m_socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+    connect(m_socket, SIGNAL(error(QAbstractSocket::SocketError)),
+            this, SLOT(onSocketError(QAbstractSocket::SocketError)));
+    connect(m_connectTimer, SIGNAL(timeout()), this, SLOT(onConnectTimeout()));
+    connect(m_helloTimer, SIGNAL(timeout()), this, SLOT(onHelloTimeout()));
+
+    AdrcIoThread::instance()->attach(this);
+}
+
+ExecuteChannel::~ExecuteChannel()
+{
+    qDebug() << "~ExecuteChannel()";
+
+    // No caller is left waiting, see onClose()
+    QMutexLocker locker(&m_mutex);
+    qDeleteAll(m_mailboxes);
+    m_mailboxes.clear();
+}
+
+void ExecuteChannel::close()
+{
+    // Wake the callers waiting for replies
+    m_mutex.lock();
+    m_closed = true;
+    QHash<quint32, Mailbox *>::const_iterator i;
+    for (i = m_mailboxes.constBegin(); i != m_mailboxes.constEnd(); ++i)
+        i.value()->ready.wakeOne();
+    m_mutex.unlock();
+
+    // The I/O thread drops the connection as soon as it gets here
+    QMetaObject::invokeMethod(this, "onClose", Qt::QueuedConnection);
+}
+
+void ExecuteChannel::onClose()
+{
+    qDebug() << "ExecuteChannel closing socket for exit...";
+
+    m_connectTimer->stop();
+    m_helloTimer->stop();
+    m_socket->disconnect(this);
+    m_socket->abort();
+
+    // Nothing will answer the requests left
+    failRequests(takePending(true, true));
+
+    // A caller still in waitForReply() deletes the channel on its way out
+    m_mutex.lock();
+    m_orphaned = true;
+    bool waiters = m_waiters > 0;
+    m_mutex.unlock();
+
+    if (!waiters)
+        deleteLater();
+}
+
+void ExecuteChannel::onSend()
+{
+    m_mutex.lock();
+    m_sendQueued = false;
+    bool closed = m_closed;
+    m_mutex.unlock();
+
+    if (closed)
+        return;
+
+    if (m_socket->state() == QAbstractSocket::UnconnectedState)
+    {
+        // (Re)connect, onConnected() sends what is queued
+        m_socket->connectToHost(m_address, m_port); // read/write
+        m_connectTimer->start(ADRCIOTHREAD_CONNECT_MSECS);
+        return;
+    }
+    if (m_socket->state() != QAbstractSocket::ConnectedState || m_negotiating)
+        return; // still connecting
+
+    // Send the new requests behind those in flight
+    //
+    m_mutex.lock();
+    //
+    QList<QPair<quint32, QString> > outgoing = m_outgoing;
+    m_outgoing.clear();
+    for (int i=0, n=outgoing.count(); i<n; i++)
+        m_inFlight.append(outgoing.at(i).first);
+    //
+    m_mutex.unlock();
+
+    for (int i=0, n=outgoing.count(); i<n; i++)
+    {
+        QString xml = outgoing.at(i).second;
+        if (m_codec.version() >= AdrcCodec::Version2)
+            xml = tagRequest(xml, outgoing.at(i).first);
+
+        QByteArray block = m_codec.frame(xml);
+        if (block.isEmpty())
+        {
+            // Too large for the framing of this hub
+            m_mutex.lock();
+            m_inFlight.removeOne(outgoing.at(i).first);
+            m_mutex.unlock();
+            failRequests(QList<quint32>() << outgoing.at(i).first);
+            continue;
+        }
+
+        if (m_socket->write(block) < 0)
+        {
+            qDebug() << "ExecuteChannel::onSend socket write error=" << m_socket->errorString();
+            break; // the lost connection fails the requests
+        }
+    }
+}
+
+void ExecuteChannel::onConnected()
+{
+    m_connectTimer->stop();
+    m_socket->setSocketOption(QAbstractSocket::LowDelayOption, QVariant(1));
+
+    if (m_wasConnected)
+    {
+        qDebug() << "ExecuteChannel reconnected to host=" << m_socket->peerAddress() << "port=" << m_socket->peerPort();
+    }
+    else
+    {
+        m_wasConnected = true;
+        emit connected(m_address, m_port);
+    }
+
+    m_codec.reset();
+
+    // No use waiting for a hub that stayed silent before
+    if (silentHubs.contains(QString("%1:%2").arg(m_address).arg(m_port)))
+    {
+        onSend();
+        return;
+    }
+
+    // Offer version 2, acceptHello() sends what is queued
+    m_negotiating = true;
+    m_helloId = nextRequestId.fetchAndAddRelaxed(1) + 1;
+    m_mutex.lock();
+    m_inFlight.append(m_helloId);
+    m_mutex.unlock();
+    m_socket->write(m_codec.frame(AdrcCodec::hello()));
+    m_helloTimer->start(ADRCCODEC_HELLO_MSECS);
+}
+
+void ExecuteChannel::onHelloTimeout()
+{
+    qDebug() << "ExecuteChannel::onHelloTimeout host=" << m_address << "port=" << m_port;
+
+    // A late answer would be taken for the reply to the first request,
+    // start again on a connection that gets no hello
+    m_negotiating = false;
+    m_mutex.lock();
+    m_inFlight.removeOne(m_helloId);
+    m_mutex.unlock();
+    m_helloId = 0;
+
+    silentHubs.insert(QString("%1:%2").arg(m_address).arg(m_port));
+
+    m_socket->abort();
+
+    // Nothing else was in flight, the held back requests go on the new one
+    m_mutex.lock();
+    bool outgoing = !m_outgoing.isEmpty();
+    m_mutex.unlock();
+    if (outgoing)
+        QMetaObject::invokeMethod(this, "onSend", Qt::QueuedConnection);
+}
+
+void ExecuteChannel::acceptHello(const QString& xml)
+{
+    m_helloTimer->stop();
+    m_negotiating = false;
+
+    m_mutex.lock();
+    m_inFlight.removeOne(m_helloId);
+    m_mutex.unlock();
+    m_helloId = 0;
+
+    m_codec.acceptHello(xml);
+
+    onSend();
+}
+
+void ExecuteChannel::onConnectTimeout()
+{
+    qDebug() << "ExecuteChannel::onConnectTimeout host=" << m_address << "port=" << m_port;
+
+    m_socket->abort();
+    emit error(QAbstractSocket::SocketTimeoutError, "Connection timed out");
+
+    // The next request tries again
+    failRequests(takePending(true, false));
+}
+
+void ExecuteChannel::onSocketError(QAbstractSocket::SocketError socketError)
+{
+    qDebug() << "ExecuteChannel::onSocketError socket error=" << m_socket->errorString();
+
+    emit error(socketError, m_socket->errorString());
+
+    // Could not connect, the next request tries again
+    if (m_connectTimer->isActive())
+    {
+        m_connectTimer->stop();
+        m_socket->abort();
+        failRequests(takePending(true, false));
+    }
+}
+
+void ExecuteChannel::onDisconnected()
+{
+    qDebug() << "ExecuteChannel::onDisconnected host=" << m_address << "port=" << m_port;
+
+    m_helloTimer->stop();
+    m_negotiating = false;
+
+    // Replies on a lost connection never come
+    failRequests(takePending(false, true));
+
+    // Requests made while it was closing go on a new connection
+    m_mutex.lock();
+    bool outgoing = !m_outgoing.isEmpty();
+    m_mutex.unlock();
+    if (outgoing)
+        QMetaObject::invokeMethod(this, "onSend", Qt::QueuedConnection);
+}
+
+void ExecuteChannel::onReadyRead()
+{
+    // The hello answer switches the framing of the frames after it
+    QString inxml;
+    while (m_codec.readFrame(m_socket, &inxml))
+    {
+        if (m_negotiating)
+            acceptHello(inxml);
+        else
+            deliverReply(inxml);
+    }
+
+    if (m_codec.isCorrupt())
+    {
+        qDebug() << "ExecuteChannel dropping connection on a corrupt frame";
+        m_socket->abort();
+    }
+}
+
+QList<quint32> ExecuteChannel::takePending(bool outgoing, bool inFlight)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QList<quint32> ids;
+    if (inFlight)
+    {
+        ids = m_inFlight;
+        m_inFlight.clear();
+    }
+    if (outgoing)
+    {
+        for (int i=0, n=m_outgoing.count(); i<n; i++)
+            ids.append(m_outgoing.at(i).first);
+        m_outgoing.clear();
+    }
+
+    return ids;
+}
+
+void ExecuteChannel::deliverReply(const QString& xml)
+{
+    QMutexLocker locker(&m_mutex);
+
+    quint32 id;
+    if (replyId(xml, &id))
+    {
+        if (!m_inFlight.contains(id))
+        {
+            qDebug() << "ExecuteChannel reply for unknown id=" << id;
+            return;
+        }
+    }
+    else // hub answers in order
+    {
+        if (m_inFlight.isEmpty())
+        {
+            qDebug() << "ExecuteChannel unexpected reply=" << xml;
+            return;
+        }
+        id = m_inFlight.first();
+    }
+
+    m_inFlight.removeOne(id);
+
+    // Return result to the client unless it gave up
+    Mailbox *box = m_mailboxes.value(id);
+    if (box)
+    {
+        box->reply = xml;
+        box->full = true;
+        box->ready.wakeOne();
+    }
+    else if (m_notify.remove(id))
+    {
+        locker.unlock();
+        emit replyReceived(id, xml, true);
+    }
+    else
+    {
+        qDebug() << "ExecuteChannel dropped reply id=" << id;
+    }
+}
+
+void ExecuteChannel::failRequests(const QList<quint32>& ids)
+{
+    QList<quint32> notify;
+
+    m_mutex.lock();
+    //
+    for (int i=0, n=ids.count(); i<n; i++)
+    {
+        Mailbox *box = m_mailboxes.value(ids.at(i));
+        if (box)
+        {
+            box->full = true;
+            box->ready.wakeOne();
+        }
+        else if (m_notify.remove(ids.at(i)))
+        {
+            notify.append(ids.at(i));
+        }
+    }
+    //
+    m_mutex.unlock();
+
+    for (int i=0, n=notify.count(); i<n; i++)
+        emit replyReceived(notify.at(i), QString(), false);
+}
+
+quint32 ExecuteChannel::executeRequest(const QString &xml, ReplyMode mode)
+{
+    QMutexLocker locker(&m_mutex);
+
+    quint32 id = nextRequestId.fetchAndAddRelaxed(1) + 1;
+    qDebug() << "Executing request id=" << id << "xml=" << xml;
+
+    m_outgoing.append(qMakePair(id, xml));
+    if (mode == WaitForReply)
+        m_mailboxes.insert(id, new Mailbox);
+    else if (mode == NotifyReply)
+        m_notify.insert(id);
+
+    // Wake the I/O thread to send it, once for a burst of requests
+    if (!m_sendQueued)
+    {
+        m_sendQueued = true;
+        QMetaObject::invokeMethod(this, "onSend", Qt::QueuedConnection);
+    }
+
+    return id;
+}
+
+QString ExecuteChannel::waitForReply(quint32 id, int timeout)
+{
+    QMutexLocker locker(&m_mutex);
+
+    Mailbox *box = m_mailboxes.value(id);
+    if (box == 0)
+        return QString(); // abandoned or not waited for
+
+    qDebug() << "Waiting for reply id=" << id;
+
+    // A reply that is already in is taken straight away
+    QElapsedTimer clock;
+    clock.start();
+    box->waiting = true;
+    m_waiters++;
+    while (!box->full && !m_closed)
+    {
+        qint64 left = timeout - clock.elapsed();
+        if (left <= 0 || !box->ready.wait(&m_mutex, left))
+            break;
+    }
+
+    // A reply arriving after a timeout is dropped
+    m_mailboxes.remove(id);
+    QString reply = box->reply;
+    delete box;
+
+    // The channel may only go once the last waiter has left it
+    bool last = --m_waiters == 0 && m_orphaned;
+    locker.unlock();
+    if (last)
+        deleteLater();
+
+    return reply;
+}
+
+void ExecuteChannel::abandonRequest(quint32 id)
+{
+    QMutexLocker locker(&m_mutex);
+
+    // The request still goes out, its reply is dropped
+    m_notify.remove(id);
+
+    Mailbox *box = m_mailboxes.value(id);
+    if (box && box->waiting)
+    {
+        // The waiting caller frees it
+        box->reply.clear();
+        box->full = true;
+        box->ready.wakeOne();
+    }
+    else if (box)
+    {
+        m_mailboxes.remove(id);
+        delete box;
+    }
+}
+
+QString ExecuteChannel::tagRequest(const QString& xml, quint32 id)
+{
+    int start = rootElement(xml);
+    if (start < 0)
+        return xml;
+
+    // Add the id after the element name
+    int end = start+1;
+    while (end < xml.size() && !xml.at(end).isSpace() && xml.at(end) != '>' && xml.at(end) != '/')
+        end++;
+
+    QString tagged = xml;
+    tagged.insert(end, QString(" %1=\"%2\"").arg(EXECUTECHANNEL_CID_ATTR).arg(id));
+
+    return tagged;
+}
+
+bool ExecuteChannel::replyId(const QString& xml, quint32 *id)
+{
+    int start = rootElement(xml);
+    int end = (start < 0) ? -1 : xml.indexOf('>', start);
+    if (end < 0)
+        return false;
+
+    // Only the root element's start tag carries the id
+    QRegExp rx(QString("\\s%1\\s*=\\s*[\"'](\\d+)[\"']").arg(EXECUTECHANNEL_CID_ATTR));
+    if (rx.indexIn(xml.mid(start, end-start)) < 0)
+        return false;
+
+    bool ok;
+    *id = rx.cap(1).toUInt(&ok);
+
+    return ok;
+}
+
+// End of file
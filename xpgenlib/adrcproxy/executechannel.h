@@ -0,0 +1,129 @@
+// This module defines the execute channel of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later 
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#ifndef EXECUTECHANNEL_H_
+#define EXECUTECHANNEL_H_
+
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QSet>
+#include <QMutex>
+#include <QTimer>
+#include <QObject>
+#include <QString>
+#include <QTcpSocket>
+#include <QWaitCondition>
+
+#include "xpadrccodec.h"
+
+#define EXECUTECHANNEL_CID_ATTR "cid"
+
+
+/*
+ * Exec connection to the ADRC daemon of a hub, served by the shared
+ * AdrcIoThread. Requests may be made and waited for from any thread
+ */
+
+class ExecuteChannel : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum ReplyMode
+    {
+        WaitForReply, // collected with waitForReply()
+        NotifyReply,  // emitted in replyReceived()
+        DiscardReply  // nobody wants it
+    };
+
+    ExecuteChannel(const QString& address, quint16 port);
+    ~ExecuteChannel();
+    //
+    // Requests are pipelined, the id matches the reply to its request
+    quint32 executeRequest(const QString& xml, ReplyMode mode = WaitForReply);
+    QString waitForReply(quint32 id, int timeout = 30000);
+    void abandonRequest(quint32 id);
+    //
+    // Fail what is pending and delete the channel on the I/O thread once
+    // no caller is left in waitForReply(), use instead of delete
+    void close();
+    //
+    // Correlation id carried as an attribute of the root element
+    static QString tagRequest(const QString& xml, quint32 id);
+    static bool replyId(const QString& xml, quint32 *id);
+
+signals:
+    void connected(QString address, quint16 port);
+    void error(int socketError, const QString& message);
+    void replyReceived(quint32 id, QString inxml, bool ok);
+
+private slots:
+    void onSend();
+    void onClose();
+    void onConnected();
+    void onConnectTimeout();
+    void onHelloTimeout();
+    void onDisconnected();
+    void onReadyRead();
+    void onSocketError(QAbstractSocket::SocketError socketError);
+
+private:
+    // Single slot handoff of one reply to the caller waiting for it
+    struct Mailbox
+    {
+        Mailbox() : full(false), waiting(false) {}
+
+        bool full;
+        bool waiting;
+        QString reply;
+        QWaitCondition ready;
+    };
+
+private:
+    void acceptHello(const QString& xml);
+    void deliverReply(const QString& xml);
+    void failRequests(const QList<quint32>& ids);
+    QList<quint32> takePending(bool outgoing, bool inFlight);
+
+private:
+    QMutex m_mutex; // guards the request state below
+    bool m_closed;
+    bool m_orphaned; // closed on the I/O thread, the last waiter deletes it
+    int m_waiters; // callers in waitForReply()
+    bool m_sendQueued; // onSend() call posted
+    QList<QPair<quint32, QString> > m_outgoing; // not written yet, the cid is added on writing
+    QList<quint32> m_inFlight; // written, oldest first
+    QHash<quint32, Mailbox *> m_mailboxes; // WaitForReply requests
+    QSet<quint32> m_notify; // NotifyReply requests
+    //
+    // Used on the I/O thread only
+    QString m_address;
+    quint16 m_port;
+    QTcpSocket *m_socket;
+    QTimer *m_connectTimer;
+    QTimer *m_helloTimer;
+    bool m_wasConnected;
+    AdrcCodec m_codec;
+    quint32 m_helloId; // in flight like a request until answered or timed out
+    bool m_negotiating; // requests wait until the hello is answered
+};
+
+#endif /* EXECUTECHANNEL_H_ */
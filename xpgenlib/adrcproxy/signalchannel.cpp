@@ -0,0 +1,177 @@
+// This module implements the signal channel of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later 
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#include <QDebug>
+#include <QHostAddress>
+
+#include "signalchannel.h"
+#include "xpadrciothread.h"
+
+// NOTES:
+// 1. Signals are read as readyRead() delivers them on the AdrcIoThread,
+//    close() takes effect as soon as the thread's loop gets to it.
+// 2. A host that can't be reached on the first attempt finishes the
+//    channel. A dropped connection is made again straight away, then
+//    every SIGNALCHANNEL_RECONNECT_MSECS while the host stays away.
+// 3. The AdrcCodec hello goes out on connecting. A hub that knows it
+//    answers before sending any signal, so a first frame that is not
+//    the answer is a signal from an old hub and the framing stays.
+//
+
+SignalChannel::SignalChannel(const QString& address, quint16 port)
+    : QObject(0), m_address(address), m_port(port), m_wasConnected(false), m_negotiating(false)
+{
+    // Children move to the I/O thread with the channel
+    m_socket = new QTcpSocket(this);
+    m_connectTimer = new QTimer(this);
+    m_connectTimer->setSingleShot(true);
+    m_reconnectTimer = new QTimer(this);
+    m_reconnectTimer->setSingleShot(true);
+
+    connect(m_socket, SIGNAL(connected()), this, SLOT(onConnected()));
+    connect(m_socket, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+    connect(m_socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+    connect(m_socket, SIGNAL(error(QAbstractSocket::SocketError)),
+            this, SLOT(onSocketError(QAbstractSocket::SocketError)));
+    connect(m_connectTimer, SIGNAL(timeout()), this, SLOT(onConnectTimeout()));
+    connect(m_reconnectTimer, SIGNAL(timeout()), this, SLOT(onOpen()));
+
+    AdrcIoThread::instance()->attach(this);
+}
+
+SignalChannel::~SignalChannel()
+{
+    qDebug() << "~SignalChannel";
+}
+
+void SignalChannel::open()
+{
+    QMetaObject::invokeMethod(this, "onOpen", Qt::QueuedConnection);
+}
+
+void SignalChannel::close()
+{
+    QMetaObject::invokeMethod(this, "onClose", Qt::QueuedConnection);
+}
+
+void SignalChannel::onOpen()
+{
+    if (m_socket->state() != QAbstractSocket::UnconnectedState)
+        return;
+
+    m_socket->connectToHost(m_address, m_port); // read/write
+    m_connectTimer->start(ADRCIOTHREAD_CONNECT_MSECS);
+}
+
+void SignalChannel::onClose()
+{
+    qDebug() << "SignalChannel closing socket for exit...";
+
+    m_connectTimer->stop();
+    m_reconnectTimer->stop();
+    m_socket->disconnect(this);
+    m_socket->abort();
+
+    deleteLater();
+}
+
+void SignalChannel::onConnected()
+{
+    m_connectTimer->stop();
+    m_socket->setSocketOption(QAbstractSocket::LowDelayOption, QVariant(1));
+
+    qDebug() << "SignalChannel connected to host=" << m_socket->peerAddress() << "port=" << m_socket->peerPort();
+
+    if (!m_wasConnected)
+    {
+        m_wasConnected = true;
+        emit connected(m_address, m_port);
+    }
+
+    // Offer version 2
+    m_codec.reset();
+    m_negotiating = true;
+    m_socket->write(m_codec.frame(AdrcCodec::hello()));
+}
+
+void SignalChannel::onConnectTimeout()
+{
+    qDebug() << "SignalChannel::onConnectTimeout host=" << m_address << "port=" << m_port;
+
+    m_socket->abort();
+    emit error(QAbstractSocket::SocketTimeoutError, "Connection timed out");
+
+    connectFailed();
+}
+
+void SignalChannel::onSocketError(QAbstractSocket::SocketError socketError)
+{
+    qDebug() << "SignalChannel::onSocketError socket error=" << m_socket->errorString();
+
+    emit error(socketError, m_socket->errorString());
+
+    if (m_connectTimer->isActive())
+    {
+        m_connectTimer->stop();
+        m_socket->abort();
+        connectFailed();
+    }
+}
+
+void SignalChannel::connectFailed()
+{
+    // Give up on a host never reached, keep trying one that went away
+    if (m_wasConnected)
+        m_reconnectTimer->start(SIGNALCHANNEL_RECONNECT_MSECS);
+    else
+        emit finished();
+}
+
+void SignalChannel::onDisconnected()
+{
+    qDebug() << "SignalChannel::onDisconnected host=" << m_address << "port=" << m_port;
+
+    // Re-estabish the host connection
+    QMetaObject::invokeMethod(this, "onOpen", Qt::QueuedConnection);
+}
+
+void SignalChannel::onReadyRead()
+{
+    // Emit the host signals
+    QString inxml;
+    while (m_codec.readFrame(m_socket, &inxml))
+    {
+        if (m_negotiating)
+        {
+            m_negotiating = false;
+            if (m_codec.acceptHello(inxml))
+                continue;
+        }
+        emit hostSignal(inxml);
+    }
+
+    if (m_codec.isCorrupt())
+    {
+        qDebug() << "SignalChannel dropping connection on a corrupt frame";
+        m_socket->abort();
+    }
+}
+
+// End of file
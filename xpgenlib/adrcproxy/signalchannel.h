@@ -0,0 +1,84 @@
+// This module defines the signal channel of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later 
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#ifndef SIGNALCHANNEL_H_
+#define SIGNALCHANNEL_H_
+
+#include <QTimer>
+#include <QObject>
+#include <QString>
+#include <QTcpSocket>
+
+#include "xpadrccodec.h"
+
+#define SIGNALCHANNEL_RECONNECT_MSECS (9*1000)
+
+
+/*
+ * Signal connection to the ADRC daemon of a hub, served by the shared
+ * AdrcIoThread
+ */
+
+class SignalChannel : public QObject
+{
+    Q_OBJECT
+
+public:
+    SignalChannel(const QString& address, quint16 port);
+    ~SignalChannel();
+    //
+    // Connect, finished() follows if the host can't be reached
+    void open();
+    //
+    // Drop the connection and delete the channel on the I/O thread,
+    // use instead of delete
+    void close();
+
+signals:
+    void connected(QString address, quint16 port);
+    void error(int socketError, const QString& message);
+    void finished();
+    //
+    void hostSignal(QString sigxml);
+
+private slots:
+    void onOpen();
+    void onClose();
+    void onConnected();
+    void onConnectTimeout();
+    void onDisconnected();
+    void onReadyRead();
+    void onSocketError(QAbstractSocket::SocketError socketError);
+
+private:
+    void connectFailed();
+
+private:
+    QString m_address;
+    quint16 m_port;
+    QTcpSocket *m_socket;
+    QTimer *m_connectTimer;
+    QTimer *m_reconnectTimer;
+    bool m_wasConnected;
+    AdrcCodec m_codec;
+    bool m_negotiating; // the first frame may answer the hello
+};
+
+#endif /* SIGNALCHANNEL_H_ */
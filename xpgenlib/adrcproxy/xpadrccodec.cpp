@@ -0,0 +1,227 @@
+// This module implements the ADRC wire codec of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#include <QDebug>
+#include <QRegExp>
+#include <QDataStream>
+#include <QtEndian>
+
+#include "xpadrccodec.h"
+
+// NOTES:
+// 1. Version 1 frames cap a message at 64 KB of UTF-16, version 2 ones
+//    carry a quint32 size, a flags byte and the XML as UTF-8.
+// 2. A version 2 payload of ADRCCODEC_COMPRESS_MIN bytes or more is
+//    deflated with qCompress() when that makes it smaller, the flags
+//    byte tells the reader. Deflate is the only codec, zlib is in every
+//    Qt build and XML shrinks well with it.
+// 3. The client sends the hello as the first frame of a connection and
+//    waits for the answer before anything else. A hub that knows the
+//    hello answers it and both ends switch after that frame. An old hub
+//    is expected to answer with an error like any request it can't make
+//    sense of and the connection stays version 1. That has not been
+//    checked against the real daemon, so a hub that stays silent is
+//    waited for ADRCCODEC_HELLO_MSECS and then taken as version 1 too.
+//
+
+#define ADRCCODEC_FLAG_DEFLATE 0x01
+
+static QRegExp helloAttr(const QString& name)
+{
+    return QRegExp(QString("\\s%1\\s*=\\s*[\"']([^\"']*)[\"']").arg(name));
+}
+
+
+AdrcCodec::AdrcCodec()
+    : m_version(Version1), m_compression(false), m_corrupt(false)
+{
+}
+
+void AdrcCodec::setVersion(Version version, bool compression)
+{
+    m_version = version;
+    m_compression = compression && version >= Version2;
+    m_corrupt = false;
+}
+
+QByteArray AdrcCodec::frame(const QString& xml) const
+{
+    if (m_version == Version1)
+    {
+        QByteArray block;
+        QDataStream out(&block, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_4_0);
+
+        // Send the XML host document to the host
+        out << (quint16) 0; // Dont know the size yet
+        out << xml;
+
+        if (block.size() - sizeof(quint16) > 0xffff)
+        {
+            qDebug() << "AdrcCodec::frame too large for version 1 size=" << block.size();
+            return QByteArray();
+        }
+
+        out.device()->seek(0); // Seek back to the size
+        out << (quint16)(block.size() - sizeof(quint16));
+
+        return block;
+    }
+
+    QByteArray payload = xml.toUtf8();
+    quint8 flags = 0;
+
+    if (m_compression && payload.size() >= ADRCCODEC_COMPRESS_MIN)
+    {
+        QByteArray deflated = qCompress(payload);
+        if (deflated.size() < payload.size())
+        {
+            payload = deflated;
+            flags |= ADRCCODEC_FLAG_DEFLATE;
+        }
+    }
+
+    QByteArray block(sizeof(quint32) + 1, 0);
+    qToBigEndian<quint32>(payload.size() + 1, reinterpret_cast<uchar *>(block.data()));
+    block[(int)sizeof(quint32)] = (char)flags;
+    block.append(payload);
+
+    return block;
+}
+
+bool AdrcCodec::readFrame(QIODevice *device, QString *xml)
+{
+    if (m_corrupt)
+        return false;
+
+    if (m_version == Version1)
+    {
+        // Only take a frame once it is complete
+        if (device->bytesAvailable() < (int)sizeof(quint16))
+            return false;
+
+        QByteArray header = device->peek(sizeof(quint16));
+        quint16 blockSize = qFromBigEndian<quint16>(reinterpret_cast<const uchar *>(header.constData()));
+        if (device->bytesAvailable() < (qint64)sizeof(quint16) + blockSize)
+            return false;
+
+        QDataStream in(device);
+        in.setVersion(QDataStream::Qt_4_0);
+        in >> blockSize >> *xml;
+
+        return true;
+    }
+
+    if (device->bytesAvailable() < (int)sizeof(quint32))
+        return false;
+
+    QByteArray header = device->peek(sizeof(quint32));
+    quint32 blockSize = qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(header.constData()));
+    if (blockSize < 1 || blockSize > ADRCCODEC_FRAME_MAX)
+    {
+        qDebug() << "AdrcCodec::readFrame bad frame size=" << blockSize;
+        m_corrupt = true;
+        return false;
+    }
+    if (device->bytesAvailable() < (qint64)sizeof(quint32) + blockSize)
+        return false;
+
+    device->read(sizeof(quint32));
+    QByteArray block = device->read(blockSize);
+    quint8 flags = (quint8)block.at(0);
+    QByteArray payload = block.mid(1);
+
+    if (flags & ~ADRCCODEC_FLAG_DEFLATE)
+    {
+        qDebug() << "AdrcCodec::readFrame unknown flags=" << flags;
+        m_corrupt = true;
+        return false;
+    }
+    if (flags & ADRCCODEC_FLAG_DEFLATE)
+    {
+        payload = qUncompress(payload);
+        if (payload.isEmpty())
+        {
+            qDebug() << "AdrcCodec::readFrame inflate error";
+            m_corrupt = true;
+            return false;
+        }
+    }
+
+    *xml = QString::fromUtf8(payload);
+
+    return true;
+}
+
+QString AdrcCodec::hello(Version version, bool compression)
+{
+    return QString("<%1 version=\"%2\" compress=\"%3\"/>").arg(ADRCCODEC_HELLO_TAG).arg((int)version)
+            .arg(compression ? "deflate" : "none");
+}
+
+bool AdrcCodec::parseHello(const QString& xml, Version *version, bool *compression)
+{
+    // The hello tag must be the root element
+    QRegExp rx(QString("^\\s*<%1(\\s[^>]*)?/?>").arg(ADRCCODEC_HELLO_TAG));
+    if (rx.indexIn(xml) < 0)
+        return false;
+    QString attrs = rx.cap(1);
+
+    QRegExp versionAttr = helloAttr("version");
+    if (versionAttr.indexIn(attrs) < 0)
+        return false;
+    *version = (versionAttr.cap(1).toInt() >= Version2) ? Version2 : Version1;
+
+    QRegExp compressAttr = helloAttr("compress");
+    *compression = compressAttr.indexIn(attrs) >= 0
+            && compressAttr.cap(1).split(QRegExp("[\\s,]+")).contains("deflate");
+
+    return true;
+}
+
+bool AdrcCodec::acceptHello(const QString& xml)
+{
+    Version version;
+    bool compression;
+    if (!parseHello(xml, &version, &compression))
+    {
+        qDebug() << "AdrcCodec host has no hello, staying on version 1";
+        return false;
+    }
+
+    setVersion(version, compression);
+    qDebug() << "AdrcCodec agreed version=" << (int)m_version << "compression=" << m_compression;
+
+    return true;
+}
+
+QString AdrcCodec::answerHello(const QString& xml, Version highest, bool compression)
+{
+    Version version;
+    bool offered;
+    if (!parseHello(xml, &version, &offered))
+        return QString();
+
+    version = qMin(version, highest);
+
+    return hello(version, compression && offered && version >= Version2);
+}
+
+// End of file
@@ -0,0 +1,78 @@
+// This module defines the ADRC wire codec of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#ifndef ADRCCODEC_H_
+#define ADRCCODEC_H_
+
+#include <QString>
+#include <QIODevice>
+#include <QByteArray>
+
+#define ADRCCODEC_HELLO_TAG "adrc-hello"
+#define ADRCCODEC_HELLO_MSECS (1*1000) // a hub silent for longer is taken as version 1
+#define ADRCCODEC_COMPRESS_MIN 512 // smaller payloads go uncompressed
+#define ADRCCODEC_FRAME_MAX (64*1024*1024) // bigger v2 frames are corrupt
+
+
+/*
+ * Frames of one ADRC connection. Every connection starts with the
+ * daemon's version 1 framing and switches to version 2 once the hello
+ * exchange has agreed on it
+ */
+
+class AdrcCodec
+{
+public:
+    enum Version
+    {
+        Version1 = 1, // quint16 size and a Qt_4_0 QString
+        Version2 = 2  // quint32 size, flags and UTF-8, deflated if large
+    };
+
+    AdrcCodec();
+    //
+    Version version() const { return m_version; }
+    bool compression() const { return m_compression; }
+    void setVersion(Version version, bool compression = false);
+    //
+    // Back to version 1 for a new connection
+    void reset() { setVersion(Version1); }
+    //
+    QByteArray frame(const QString& xml) const;
+    bool readFrame(QIODevice *device, QString *xml); // false until a whole frame is in
+    bool isCorrupt() const { return m_corrupt; } // the connection must be dropped
+    //
+    // Negotiation, the hello and its answer go in version 1 frames
+    static QString hello(Version version = Version2, bool compression = true);
+    static bool parseHello(const QString& xml, Version *version, bool *compression);
+    //
+    // Client side: take the hub's answer, an old hub's makes no change
+    bool acceptHello(const QString& xml);
+    //
+    // Hub side: the answer to a hello, the best both ends support
+    static QString answerHello(const QString& xml, Version highest, bool compression);
+
+private:
+    Version m_version;
+    bool m_compression;
+    bool m_corrupt;
+};
+
+#endif /* ADRCCODEC_H_ */
@@ -0,0 +1,72 @@
+// This module implements the ADRC I/O thread of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later 
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#include <QDebug>
+#include <QMutexLocker>
+#include <QCoreApplication>
+
+#include "xpadrciothread.h"
+
+// NOTES:
+// 1. Channels only react to socket, timer and queued call events, so the
+//    thread sleeps in its event loop and nothing ever polls or waits.
+// 2. Closing a channel is a queued call too, it takes effect as soon as
+//    the loop gets to it.
+//
+
+AdrcIoThread *AdrcIoThread::m_instance = 0;
+QMutex AdrcIoThread::m_instanceMutex;
+
+
+AdrcIoThread *AdrcIoThread::instance()
+{
+    QMutexLocker locker(&m_instanceMutex);
+
+    if (m_instance == 0)
+        m_instance = new AdrcIoThread(QCoreApplication::instance());
+
+    return m_instance;
+}
+
+AdrcIoThread::AdrcIoThread(QObject *parent)
+    : QObject(parent)
+{
+    m_thread.setObjectName("AdrcIoThread");
+    m_thread.start();
+}
+
+AdrcIoThread::~AdrcIoThread()
+{
+    qDebug() << "~AdrcIoThread";
+
+    // Stop the thread and wait until it exits
+    m_thread.quit();
+    m_thread.wait();
+
+    QMutexLocker locker(&m_instanceMutex);
+    m_instance = 0;
+}
+
+void AdrcIoThread::attach(QObject *channel)
+{
+    channel->moveToThread(&m_thread);
+}
+
+// End of file
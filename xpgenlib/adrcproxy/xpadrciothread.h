@@ -1,4 +1,4 @@
-// This module defines the execute thread of the XPGENLIB library.
+// This module defines the ADRC I/O thread of the XPGENLIB library.
 //
 // Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
 //
@@ -18,47 +18,40 @@
 // This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
 // WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
 
-#ifndef EXECUTETHREAD_H_
-#define EXECUTETHREAD_H_
+#ifndef ADRCIOTHREAD_H_
+#define ADRCIOTHREAD_H_
 
+#include <QMutex>
 #include <QObject>
-#include <QString>
 #include <QThread>
-#include <QMutex>
-#include <QWaitCondition>
 
-class ExecuteThread : public QThread
+#define ADRCIOTHREAD_CONNECT_MSECS (5*1000)
+
+
+/*
+ * One event driven thread carrying the socket I/O of every ADRC exec
+ * and signal channel, for any number of hubs
+ */
+
+class AdrcIoThread : public QObject
 {
     Q_OBJECT
 
 public:
-    ExecuteThread(const QString& address, quint16 port, QObject *parent = 0);
-    ~ExecuteThread();
-    //
-    void executeRequest(const QString& xml);
-    QString waitForReply(int timeout = 30000);
+    static AdrcIoThread *instance();
 
-signals:
-    void connected(QString address, quint16 port);
-    void error(int socketError, const QString& message);
+    // Move a channel without parent onto the I/O thread
+    void attach(QObject *channel);
 
-protected:
-    virtual void run();
+private:
+    explicit AdrcIoThread(QObject *parent = 0);
+    ~AdrcIoThread();
 
 private:
-    bool quit;
-    //
-    QMutex m_execMutex;
-    QWaitCondition m_execReceived;
-    //
-    QMutex m_replyMutex;
-    QWaitCondition m_replyReady;
-    bool m_waitingForReply;
+    static AdrcIoThread *m_instance; // this is a singleton
+    static QMutex m_instanceMutex;
     //
-    QString m_address;
-    quint16 m_port;
-    QString m_inxml;
-    QString m_outxml;
+    QThread m_thread;
 };
 
-#endif /* EXECUTETHREAD_H_ */
+#endif /* ADRCIOTHREAD_H_ */
@@ -0,0 +1,105 @@
+// This module implements the ADRC reply of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later 
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#include <QDebug>
+#include <QEventLoop>
+
+#include "xpadrcreply.h"
+
+// NOTES:
+// 1. The proxy owns the request, the caller owns the reply: deleting an
+//    unfinished reply abandons the request like cancel().
+// 2. finished() is always emitted from the event loop, never from inside
+//    ExecuteAsync(), so it is safe to connect after the call.
+//
+
+AdrcReply::AdrcReply(QObject *parent)
+    : QObject(parent), m_finished(false)
+{
+    m_deadline.setSingleShot(true);
+    connect(&m_deadline, SIGNAL(timeout()), this, SLOT(onDeadline()));
+}
+
+AdrcReply::~AdrcReply()
+{
+    // Nobody will collect the reply any more
+    if (!m_finished)
+        emit abortRequested();
+}
+
+void AdrcReply::setDeadline(int msecs)
+{
+    if (m_finished)
+        return;
+
+    if (msecs > 0)
+        m_deadline.start(msecs);
+    else
+        m_deadline.stop();
+}
+
+bool AdrcReply::waitForFinished()
+{
+    if (!m_finished)
+    {
+        // Wait here for the reply
+        //
+        QEventLoop loop;
+        connect(this, SIGNAL(finished(QString)), &loop, SLOT(quit()));
+        loop.exec();
+    }
+
+    return isOk();
+}
+
+void AdrcReply::cancel()
+{
+    if (m_finished)
+        return;
+
+    finish(QString(), "Canceled");
+    emit abortRequested();
+}
+
+void AdrcReply::onDeadline()
+{
+    qDebug() << "AdrcReply::onDeadline timed out";
+
+    if (m_finished)
+        return;
+
+    finish(QString(), "Timed out");
+    emit abortRequested();
+}
+
+void AdrcReply::finish(QString inxml, QString errorString)
+{
+    if (m_finished)
+        return;
+
+    m_deadline.stop();
+    m_finished = true;
+    m_result = inxml;
+    m_errorString = errorString;
+
+    emit finished(m_result);
+}
+
+// End of file
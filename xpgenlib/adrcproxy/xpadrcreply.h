@@ -0,0 +1,75 @@
+// This module defines the ADRC reply of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later 
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#ifndef ADRCREPLY_H_
+#define ADRCREPLY_H_
+
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+
+/*
+ * Reply to an AdrcTcpProxy::ExecuteAsync() request, finished() is
+ * emitted once with the host reply or with an error
+ */
+
+class AdrcReply : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AdrcReply(QObject *parent = 0);
+    ~AdrcReply();
+    //
+    bool isFinished() { return m_finished; }
+    bool isOk() { return m_finished && m_errorString.isEmpty(); }
+    QString result() { return m_result; }
+    QString errorString() { return m_errorString; }
+    //
+    // Give up on the reply after msecs, 0 waits for ever
+    void setDeadline(int msecs);
+    //
+    // Block until finished, events are processed meanwhile so the caller
+    // may be re-entered, AdrcTcpProxy::Execute() blocks without that
+    bool waitForFinished();
+
+public slots:
+    // Stop waiting, the request may still reach the host
+    void cancel();
+
+signals:
+    void finished(QString inxml);
+    void abortRequested();
+
+private slots:
+    void onDeadline();
+    void finish(QString inxml, QString errorString);
+
+private:
+    friend class AdrcTcpProxy;
+    //
+    bool m_finished;
+    QString m_result;
+    QString m_errorString;
+    QTimer m_deadline;
+};
+
+#endif /* ADRCREPLY_H_ */
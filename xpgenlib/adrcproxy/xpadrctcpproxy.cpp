@@ -30,14 +30,14 @@
 
 QString AdrcTcpProxy::hostAddress;
 int AdrcTcpProxy::instanceCount = 0;
-SignalThread *AdrcTcpProxy::signalListner = 0;
+SignalChannel *AdrcTcpProxy::signalListner = 0;
 
 
 AdrcTcpProxy::AdrcTcpProxy(QString addressAndPort, QObject *parent)
     : QObject(parent)
 {
     instanceCount++;
-    executeThread = 0;
+    executeChannel = 0;
 
     // Extract the host IP address and port
     QStringList tokens = addressAndPort.split(QChar(':'));
@@ -69,12 +69,13 @@ AdrcTcpProxy::~AdrcTcpProxy()
 
     instanceCount--;
 
-    if (executeThread)
-        delete executeThread;
+    if (executeChannel)
+        executeChannel->close();
+    failReplies("Proxy closed");
 
     if (instanceCount == 0 && signalListner)
     {
-        delete signalListner;
+        signalListner->close();
         signalListner = 0;
     }
 }
@@ -93,44 +94,106 @@ QString AdrcTcpProxy::Execute(const QString &outxml, unsigned long timeoutMs)
         return QString();
     }
 
-    if (executeThread == 0)
+    if (executeChannel == 0)
+        createExecuteChannel();
+
+    // Client does not want to wait for a reply
+    if (timeoutMs == 0)
     {
-        executeThread = new ExecuteThread(m_address, m_port, this);
-        connect(executeThread, SIGNAL(finished()), this, SLOT(onHostFinished()));
-        connect(executeThread, SIGNAL(error(int,QString)), this, SLOT(onHostError(int,QString)));
-        connect(executeThread, SIGNAL(connected(QString,quint16)), this, SLOT(onHostConnected(QString,quint16)));
+        executeChannel->executeRequest(outxml, ExecuteChannel::DiscardReply);
+        return QString();
     }
 
-    executeThread->executeRequest(outxml);
-    QString inxml = executeThread->waitForReply(timeoutMs);
+    // Block without an event loop, nothing can run in the caller meanwhile
+    quint32 id = executeChannel->executeRequest(outxml, ExecuteChannel::WaitForReply);
+    QString inxml = executeChannel->waitForReply(id, timeoutMs);
     qDebug() << "host reply=" << inxml;
 
     return inxml;
 }
 
-void AdrcTcpProxy::onHostConnected(QString address, quint16 port)
+AdrcReply *AdrcTcpProxy::ExecuteAsync(const QString& outxml, int timeoutMs, QObject *parent)
 {
-    qDebug() << "AdrcTcpProxy: connected to exec service=" << address
-             << "at port=" << port;
+    AdrcReply *reply = new AdrcReply(parent);
+
+    if (!isValid())
+    {
+        qDebug() << "AdrcTcpProxy::ExecuteAsync error network is off-line";
+        QMetaObject::invokeMethod(reply, "finish", Qt::QueuedConnection,
+                                  Q_ARG(QString, QString()), Q_ARG(QString, QString("Network is off-line")));
+        return reply;
+    }
+
+    if (executeChannel == 0)
+        createExecuteChannel();
+
+    // The reply comes back through onHostReply()
+    quint32 id = executeChannel->executeRequest(outxml, ExecuteChannel::NotifyReply);
+    m_replies.insert(id, reply);
+    connect(reply, SIGNAL(abortRequested()), this, SLOT(onReplyAborted()));
+    reply->setDeadline(timeoutMs);
+
+    return reply;
 }
 
-void AdrcTcpProxy::onHostError(int error, QString message)
+void AdrcTcpProxy::createExecuteChannel()
 {
-    qDebug() << "AdrcTcpProxy: exec service error=" << error
-             << "message=" << message;
+    executeChannel = new ExecuteChannel(m_address, m_port);
+    connect(executeChannel, SIGNAL(error(int,QString)), this, SLOT(onHostError(int,QString)));
+    connect(executeChannel, SIGNAL(connected(QString,quint16)), this, SLOT(onHostConnected(QString,quint16)));
+    connect(executeChannel, SIGNAL(replyReceived(quint32,QString,bool)),
+            this, SLOT(onHostReply(quint32,QString,bool)), Qt::QueuedConnection);
 }
 
-void AdrcTcpProxy::onHostFinished()
+void AdrcTcpProxy::failReplies(const QString& errorString)
 {
-    qDebug() << "AdrcTcpProxy: exec service finished";
+    // Nothing will answer these any more, they finish from the event loop
+    // so no slot runs inside the destructor or the online state change
+    QList<AdrcReply *> replies = m_replies.values();
+    m_replies.clear();
 
-    if (executeThread)
+    for (int i=0, n=replies.count(); i<n; i++)
     {
-        executeThread->deleteLater();
-        executeThread = 0;
+        replies.at(i)->disconnect(this);
+        QMetaObject::invokeMethod(replies.at(i), "finish", Qt::QueuedConnection,
+                                  Q_ARG(QString, QString()), Q_ARG(QString, errorString));
     }
 }
 
+void AdrcTcpProxy::onHostReply(quint32 id, QString inxml, bool ok)
+{
+    AdrcReply *reply = m_replies.take(id);
+    if (reply == 0)
+        return; // canceled or timed out
+
+    reply->finish(inxml, ok ? QString() : QString("Host connection failed"));
+}
+
+void AdrcTcpProxy::onReplyAborted()
+{
+    // The reply may be half destroyed, only its address is used
+    AdrcReply *reply = static_cast<AdrcReply *>(sender());
+    quint32 id = m_replies.key(reply, 0);
+    if (id == 0)
+        return;
+
+    m_replies.remove(id);
+    if (executeChannel)
+        executeChannel->abandonRequest(id);
+}
+
+void AdrcTcpProxy::onHostConnected(QString address, quint16 port)
+{
+    qDebug() << "AdrcTcpProxy: connected to exec service=" << address
+             << "at port=" << port;
+}
+
+void AdrcTcpProxy::onHostError(int error, QString message)
+{
+    qDebug() << "AdrcTcpProxy: exec service error=" << error
+             << "message=" << message;
+}
+
 void AdrcTcpProxy::onNetOnlineStateChanged(bool online)
 {
     qDebug() << "AdrcTcpProxy::onNetOnlineStateChanged: online=" << online;
@@ -141,15 +204,16 @@ void AdrcTcpProxy::onNetOnlineStateChanged(bool online)
     {
         qDebug() << "AdrcTcpProxy: stopped listening due to network offline";
 
-        if (executeThread)
+        if (executeChannel)
         {
-            delete executeThread;
-            executeThread = 0;
+            executeChannel->close();
+            executeChannel = 0;
         }
+        failReplies("Network is off-line");
 
         if (signalListner)
         {
-            delete signalListner;
+            signalListner->close();
             signalListner = 0;
         }
 
@@ -160,23 +224,23 @@ void AdrcTcpProxy::onNetOnlineStateChanged(bool online)
     // If online start services
     //
 #if 0
-    if (executeThread)
+    if (executeChannel)
     {
-        delete executeThread;
-        executeThread = 0;
+        executeChannel->close();
+        executeChannel = 0;
     }
 #endif
 
     // Create only one signal listner (singleton)
     if (signalListner == 0)
     {
-        signalListner = new SignalThread(m_address, m_port+1);
+        signalListner = new SignalChannel(m_address, m_port+1);
         //connect(signalListner, SIGNAL(hostSignal(QString)), this, SLOT(onHostSignal(QString)));
         connect(signalListner, SIGNAL(connected(QString,quint16)), this, SLOT(onSignalConnected(QString,quint16)));
         connect(signalListner, SIGNAL(error(int,QString)), this, SLOT(onSignalError(int,QString)));
         connect(signalListner, SIGNAL(finished()), this, SLOT(onSignalFinished()));
         //
-        signalListner->start();
+        signalListner->open();
     }
     connect(signalListner, SIGNAL(hostSignal(QString)), this, SLOT(onHostSignal(QString)));
 
@@ -217,7 +281,7 @@ void AdrcTcpProxy::onSignalFinished()
 
     if (signalListner)
     {
-        signalListner->deleteLater();
+        signalListner->close();
         signalListner = 0;
     }
 }
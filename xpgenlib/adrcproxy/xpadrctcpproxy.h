@@ -21,11 +21,13 @@
 #ifndef ADRCTCPPROXY_H_1279150723
 #define ADRCTCPPROXY_H_1279150723
 
+#include <QHash>
 #include <QObject>
 #include <QString>
 
-#include "executethread.h"
-#include "signalthread.h"
+#include "executechannel.h"
+#include "signalchannel.h"
+#include "xpadrcreply.h"
 
 
 /*
@@ -43,7 +45,12 @@ public:
     bool isValid();
     int getHostPort() { return m_port; }
     QString getHostAddress() { return m_address; }
+    //
+    // Blocks the calling thread, no events are processed until it returns
     QString Execute(const QString& outxml, unsigned long timeoutMs = 5000);
+    //
+    // The reply belongs to the caller, timeoutMs 0 means no deadline
+    AdrcReply *ExecuteAsync(const QString& outxml, int timeoutMs = 5000, QObject *parent = 0);
 
 signals:
     void ProximityEvent(QString sigxml);
@@ -60,17 +67,23 @@ private slots:
     void onHostConnected(QString address, quint16 port);
     void onHostError(int error, QString message);
     void onHostSignal(QString sigxml);
-    void onHostFinished();
+    void onHostReply(quint32 id, QString inxml, bool ok);
+    void onReplyAborted();
     void onNetOnlineStateChanged(bool online);
     void onSignalConnected(QString address, quint16 port);
     void onSignalError(int socketError, const QString& message);
     void onSignalFinished();
 
+private:
+    void createExecuteChannel();
+    void failReplies(const QString& errorString);
+
 private: // data
-    static SignalThread *signalListner; // this is a singleton
+    static SignalChannel *signalListner; // this is a singleton
     static int instanceCount; // number of proxy instances
     static QString hostAddress;
-    ExecuteThread *executeThread;
+    ExecuteChannel *executeChannel;
+    QHash<quint32, AdrcReply *> m_replies; // by request id
     QString m_address;
     int m_port;
 };
@@ -0,0 +1,132 @@
+// This module implements the gzip device of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#include <QDebug>
+#include <QBuffer>
+
+#include "xpgzipdevice.h"
+
+// NOTES:
+// 1. The source is read in XPGZIPDEVICE_CHUNK blocks and deflated on the fly,
+//    only compressed output is ever held in memory.
+// 2. Output has a gzip header and trailer (zlib window bits 15+16).
+// 3. readData() returns -1 once the gzip trailer has been read.
+//
+
+XPGzipDevice::XPGzipDevice(QIODevice *source, QObject *parent)
+    : QIODevice(parent), m_source(source), m_sourceEnd(false), m_streamEnd(false)
+{
+    memset(&m_stream, 0, sizeof(m_stream));
+}
+
+XPGzipDevice::~XPGzipDevice()
+{
+    if (isOpen())
+        close();
+}
+
+bool XPGzipDevice::open(OpenMode mode)
+{
+    if (mode != QIODevice::ReadOnly || !m_source || !m_source->isReadable())
+    {
+        setErrorString("Gzip device is read only and needs a readable source");
+        return false;
+    }
+
+    memset(&m_stream, 0, sizeof(m_stream));
+    if (deflateInit2(&m_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        setErrorString("Unable to initialize gzip stream");
+        return false;
+    }
+
+    m_input.resize(XPGZIPDEVICE_CHUNK);
+    m_sourceEnd = false;
+    m_streamEnd = false;
+
+    return QIODevice::open(mode);
+}
+
+void XPGzipDevice::close()
+{
+    deflateEnd(&m_stream);
+    QIODevice::close();
+}
+
+qint64 XPGzipDevice::readData(char *data, qint64 maxSize)
+{
+    if (m_streamEnd)
+        return -1;
+
+    uInt outSize = (uInt)qMin<qint64>(maxSize, XPGZIPDEVICE_CHUNK);
+    m_stream.next_out = reinterpret_cast<Bytef *>(data);
+    m_stream.avail_out = outSize;
+
+    while (m_stream.avail_out > 0)
+    {
+        // Refill the input from the source
+        if (m_stream.avail_in == 0 && !m_sourceEnd)
+        {
+            qint64 n = m_source->read(m_input.data(), m_input.size());
+            if (n <= 0)
+                m_sourceEnd = true;
+            m_stream.next_in = reinterpret_cast<Bytef *>(m_input.data());
+            m_stream.avail_in = (n > 0) ? (uInt)n : 0;
+        }
+
+        int ret = deflate(&m_stream, m_sourceEnd ? Z_FINISH : Z_NO_FLUSH);
+        if (ret == Z_STREAM_END)
+        {
+            m_streamEnd = true;
+            break;
+        }
+        if (ret != Z_OK && ret != Z_BUF_ERROR)
+        {
+            qDebug() << "XPGzipDevice::readData deflate error=" << ret;
+            setErrorString("Gzip compression failed");
+            return -1;
+        }
+    }
+
+    return outSize - m_stream.avail_out;
+}
+
+qint64 XPGzipDevice::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+
+    return -1; // read only
+}
+
+QByteArray XPGzipDevice::compress(const QByteArray& data)
+{
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+
+    XPGzipDevice gzip(&buffer);
+    if (!gzip.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    return gzip.readAll();
+}
+
+// End of file
@@ -0,0 +1,65 @@
+// This module defines the gzip device of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#ifndef XPGZIPDEVICE_H
+#define XPGZIPDEVICE_H
+
+#include <zlib.h>
+
+#include <QIODevice>
+#include <QByteArray>
+
+#define XPGZIPDEVICE_CHUNK (64*1024)
+
+
+/*
+ * Read only device that gzips its source device as it is read
+ */
+
+class XPGzipDevice : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    explicit XPGzipDevice(QIODevice *source, QObject *parent = 0);
+    ~XPGzipDevice();
+
+    bool open(OpenMode mode);
+    void close();
+    bool isSequential() const { return true; }
+    // The source may be at its end long before the trailer is out, so the end
+    // is the end of the gzip stream once QIODevice has handed out its buffer
+    bool atEnd() const { return m_streamEnd && QIODevice::atEnd(); }
+
+    static QByteArray compress(const QByteArray& data);
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 maxSize);
+
+private:
+    QIODevice *m_source;
+    QByteArray m_input;
+    z_stream m_stream;
+    bool m_sourceEnd;
+    bool m_streamEnd;
+};
+
+#endif // XPGZIPDEVICE_H
@@ -0,0 +1,128 @@
+// This module implements the network file batch of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#include <QDebug>
+#include <QTimer>
+#include <QEventLoop>
+
+#include "xpnetfile.h"
+#include "xpnetbatch.h"
+
+// NOTES:
+// 1. Fetches many files with at most maxInFlight transfers running at once.
+// 2. Each item is an XPNetFile so ETags and cache paths behave the same.
+// 3. itemFinished() reports every item, finished() reports the whole batch.
+// 4. All items share the batch's priority in the pool.
+//
+
+#define XPNETBATCH_INDEX "xpnetbatch-index"
+
+
+XPNetBatch::XPNetBatch(const QList<XPNetBatchItem>& items, int maxInFlight, QObject *parent,
+                       XPNetPool::Priority priority)
+    : QObject(parent), m_maxInFlight(maxInFlight), m_nextIndex(0), m_inFlightCount(0), m_finishedCount(0)
+{
+    if (m_maxInFlight < 1)
+        m_maxInFlight = 1;
+
+    for (int i=0, n=items.count(); i<n; i++)
+    {
+        XPNetFile *file = new XPNetFile(items.at(i).first, items.at(i).second, this);
+        file->setProperty(XPNETBATCH_INDEX, i);
+        file->setPriority(priority);
+        connect(file, SIGNAL(finished(bool)), this, SLOT(onFileFinished(bool)));
+        m_files.append(file);
+        m_results.append(0);
+    }
+}
+
+XPNetBatch::~XPNetBatch()
+{
+}
+
+void XPNetBatch::start()
+{
+    // An empty batch is finished straight away
+    if (m_files.isEmpty())
+    {
+        QMetaObject::invokeMethod(this, "finished", Qt::QueuedConnection);
+        return;
+    }
+
+    startNext();
+}
+
+bool XPNetBatch::waitForFinished(int msecs)
+{
+    if (!isFinished())
+    {
+        QTimer timer;
+        QEventLoop loop;
+        timer.setSingleShot(true);
+        connect(&timer, SIGNAL(timeout()), &loop, SLOT(quit()));
+        connect(this, SIGNAL(finished()), &loop, SLOT(quit()));
+        timer.start(msecs);
+        loop.exec();
+    }
+
+    return isFinished();
+}
+
+QString XPNetBatch::localFilePath(int index)
+{
+    return m_files.at(index)->localFilePath();
+}
+
+QString XPNetBatch::errorString(int index)
+{
+    return m_files.at(index)->errorString();
+}
+
+void XPNetBatch::onFileFinished(bool ok)
+{
+    int index = sender()->property(XPNETBATCH_INDEX).toInt();
+
+    m_results[index] = ok ? 1 : -1;
+    m_inFlightCount--;
+    m_finishedCount++;
+
+    emit itemFinished(index, ok);
+
+    if (isFinished())
+    {
+        qDebug() << "XPNetBatch::onFileFinished all" << m_finishedCount << "items done";
+        emit finished();
+        return;
+    }
+
+    startNext();
+}
+
+void XPNetBatch::startNext()
+{
+    // Keep the pipe full up to the in-flight limit
+    while (m_inFlightCount < m_maxInFlight && m_nextIndex < m_files.count())
+    {
+        m_inFlightCount++;
+        m_files.at(m_nextIndex++)->existsAsync();
+    }
+}
+
+// End of file
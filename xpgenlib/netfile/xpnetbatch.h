@@ -0,0 +1,78 @@
+// This module defines the network file batch of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#ifndef XPNETBATCH_H
+#define XPNETBATCH_H
+
+#include <QUrl>
+#include <QList>
+#include <QPair>
+#include <QObject>
+#include <QString>
+
+#include "xpnetpool.h"
+
+#define XPNETBATCH_MAXINFLIGHT 16
+
+class XPNetFile;
+
+typedef QPair<QUrl, QString> XPNetBatchItem; // URL and local path
+
+
+class XPNetBatch : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit XPNetBatch(const QList<XPNetBatchItem>& items, int maxInFlight = XPNETBATCH_MAXINFLIGHT, QObject *parent = 0,
+                        XPNetPool::Priority priority = XPNetPool::Normal);
+    ~XPNetBatch();
+
+    void start();
+    bool isFinished() { return m_finishedCount == m_files.count(); }
+    bool waitForFinished(int msecs = 30000);
+
+    // Per item results, valid once the item has finished
+    int count() { return m_files.count(); }
+    bool isOk(int index) { return m_results.at(index) > 0; }
+    bool isPending(int index) { return m_results.at(index) == 0; }
+    QString localFilePath(int index);
+    QString errorString(int index);
+
+signals:
+    void itemFinished(int index, bool ok);
+    void finished();
+
+private slots:
+    void onFileFinished(bool ok);
+
+private:
+    void startNext();
+
+private:
+    int m_maxInFlight;
+    int m_nextIndex;
+    int m_inFlightCount;
+    int m_finishedCount;
+    QList<XPNetFile *> m_files;
+    QList<int> m_results; // 0 pending, 1 ok, -1 failed
+};
+
+#endif // XPNETBATCH_H
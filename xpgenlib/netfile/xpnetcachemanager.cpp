@@ -0,0 +1,371 @@
+// This module implements the cache manager of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#include <QSet>
+#include <QPair>
+#include <QFile>
+#include <QDebug>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QSettings>
+#include <QStringList>
+#include <QDirIterator>
+#include <QMutexLocker>
+
+#include "xpnetfile.h"
+#include "xpnetetagindex.h"
+#include "xpnetpackstore.h"
+#include "xpnetcachemanager.h"
+
+// NOTES:
+// 1. Recency is kept in memory, files not used this session fall back
+//    to their modified or last read time.
+// 2. A scan of the cache root rebuilds the sizes and the total bytes,
+//    it runs once at startup and whenever a download takes the cache
+//    over its quota.
+// 3. Eviction removes the oldest files down to the low watermark and
+//    drops their ETag records.
+// 4. Only files fetched from the hub and unchanged since, those with a
+//    matching ETag record, are evicted. Files saved into the cache root by hand, like the
+//    simulator's profile, and files pinned by an open editor stay.
+//    The ETag index and recent partial downloads are never evicted,
+//    leftover .xpetagcache files from old versions are removed.
+// 5. The quota comes from the "net-cache/quotaMB" setting.
+// 6. With the pack store on, a pass over the quota first drops the loose
+//    copies of packed files not used this session, oldest first, the pack
+//    writes them back when asked for. Only then are files evicted, and
+//    evicted files leave the pack too. Under the quota nothing is dropped,
+//    so startup never costs the next session an extract per file.
+//
+
+/* Static class variables
+ */
+
+XPNetCacheManager *XPNetCacheManager::m_instance = 0;
+QMutex XPNetCacheManager::m_instanceMutex;
+
+
+XPNetCacheManager *XPNetCacheManager::instance()
+{
+    QMutexLocker locker(&m_instanceMutex);
+
+    if (m_instance == 0)
+    {
+        m_instance = new XPNetCacheManager(XPNetEtagIndex::instance()->cacheRoot());
+        m_instance->requestEviction(); // initial scan
+    }
+
+    return m_instance;
+}
+
+XPNetCacheManager *XPNetCacheManager::existingInstance()
+{
+    QMutexLocker locker(&m_instanceMutex);
+
+    return m_instance;
+}
+
+XPNetCacheManager::XPNetCacheManager(const QString& cacheRoot)
+    : m_cacheRoot(cacheRoot), m_totalBytes(0), m_scanned(false), m_evicting(false),
+      m_evictRequested(false), m_sessionStart(QDateTime::currentMSecsSinceEpoch()),
+      m_hits(0), m_misses(0), m_evictions(0)
+{
+    QSettings settings;
+    m_quota = settings.value(XPNETCACHEMANAGER_QUOTA_KEY, XPNETCACHEMANAGER_DEFAULT_QUOTA).toLongLong()*1024*1024;
+
+    setObjectName("XPNetCacheManager");
+}
+
+XPNetCacheManager::~XPNetCacheManager()
+{
+    wait();
+}
+
+void XPNetCacheManager::recordHit(const QString& localPath)
+{
+    touch(localPath, false);
+
+    QMutexLocker locker(&m_mutex);
+    m_hits++;
+}
+
+void XPNetCacheManager::recordMiss(const QString& localPath)
+{
+    touch(localPath, true);
+
+    QMutexLocker locker(&m_mutex);
+    m_misses++;
+    bool over = m_scanned && m_totalBytes > m_quota;
+    locker.unlock();
+
+    if (over)
+        requestEviction();
+}
+
+quint64 XPNetCacheManager::hits()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_hits;
+}
+
+quint64 XPNetCacheManager::misses()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_misses;
+}
+
+quint64 XPNetCacheManager::evictions()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_evictions;
+}
+
+qint64 XPNetCacheManager::totalBytes()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_totalBytes;
+}
+
+void XPNetCacheManager::requestEviction()
+{
+    QMutexLocker locker(&m_mutex);
+
+    // A running pass picks the request up before it exits
+    m_evictRequested = true;
+    if (m_evicting)
+        return;
+    m_evicting = true;
+    locker.unlock();
+
+    wait(); // the last pass may still be on its way out
+    start(QThread::LowestPriority);
+}
+
+void XPNetCacheManager::pin(const QString& localPath)
+{
+    QMutexLocker locker(&m_mutex);
+    m_pinned.insert(QFileInfo(localPath).absoluteFilePath());
+}
+
+void XPNetCacheManager::unpin(const QString& localPath)
+{
+    QMutexLocker locker(&m_mutex);
+    m_pinned.remove(QFileInfo(localPath).absoluteFilePath());
+}
+
+void XPNetCacheManager::run()
+{
+    forever
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_evictRequested)
+        {
+            m_evicting = false;
+            return;
+        }
+        m_evictRequested = false;
+        locker.unlock();
+
+        evict();
+    }
+}
+
+void XPNetCacheManager::touch(const QString& localPath, bool fetched)
+{
+    if (!isManaged(localPath))
+        return;
+
+    QString path = QFileInfo(localPath).absoluteFilePath();
+    qint64 size = QFileInfo(path).size();
+
+    QMutexLocker locker(&m_mutex);
+
+    QHash<QString, Entry>::iterator i = m_entries.find(path);
+    if (i == m_entries.end())
+    {
+        Entry entry;
+        entry.size = 0;
+        entry.lastAccess = 0;
+        i = m_entries.insert(path, entry);
+        fetched = true;
+    }
+
+    if (fetched)
+    {
+        m_totalBytes += size - i.value().size;
+        i.value().size = size;
+    }
+    i.value().lastAccess = QDateTime::currentMSecsSinceEpoch();
+}
+
+bool XPNetCacheManager::isManaged(const QString& localPath)
+{
+    QString path = QFileInfo(localPath).absoluteFilePath();
+    if (!path.startsWith(m_cacheRoot + "/"))
+        return false;
+
+    // The indexes, the pack and their compaction temp files
+    QString fileName = QFileInfo(path).fileName();
+    if (fileName.startsWith(XPNETETAGINDEX_FILENAME) || fileName.startsWith(XPNETPACKSTORE_FILENAME))
+        return false;
+
+    // Files open in an editor may hold unsynced edits
+    m_mutex.lock();
+    bool pinned = m_pinned.contains(path);
+    m_mutex.unlock();
+    if (pinned)
+        return false;
+
+    // Only what was fetched from the hub, and not saved over since, can
+    // be fetched again
+    if (path.endsWith(XPNETFILE_PARTSUFFIX))
+        return !XPNetEtagIndex::instance()->value(path).isEmpty();
+    return XPNetEtagIndex::instance()->isUnmodified(path);
+}
+
+void XPNetCacheManager::evict()
+{
+    qint64 scanStart = QDateTime::currentMSecsSinceEpoch();
+
+    // Scan the cache root without holding the lock
+    //
+    XPNetPackStore *pack = XPNetPackStore::instance();
+
+    QHash<QString, Entry> found;
+    QSet<QString> packed;
+    QDirIterator it(m_cacheRoot, QDir::Files | QDir::Hidden | QDir::NoSymLinks, QDirIterator::Subdirectories);
+    while (it.hasNext())
+    {
+        QString path = it.next();
+        QFileInfo fi = it.fileInfo();
+
+        if (fi.fileName() == ".xpetagcache")
+        {
+            QFile::remove(path); // replaced by the ETag index
+            continue;
+        }
+        if (!isManaged(path))
+            continue;
+
+        Entry entry;
+        entry.size = fi.size();
+        entry.lastAccess = qMax(fi.lastModified().toMSecsSinceEpoch(), fi.lastRead().toMSecsSinceEpoch());
+
+        // A file the pack holds can give up its loose copy when space is short
+        if (pack->isEnabled() && pack->isPacked(path))
+            packed.insert(path);
+
+        found.insert(path, entry);
+    }
+
+    // Merge in this session's accesses and pick the victims
+    //
+    QStringList victims;
+    QStringList drops;
+    {
+        QMutexLocker locker(&m_mutex);
+
+        QHash<QString, Entry>::const_iterator i;
+        for (i = m_entries.constBegin(); i != m_entries.constEnd(); ++i)
+        {
+            QHash<QString, Entry>::iterator f = found.find(i.key());
+            if (f != found.end())
+                f.value().lastAccess = qMax(f.value().lastAccess, i.value().lastAccess);
+            else if (i.value().lastAccess >= scanStart)
+                found.insert(i.key(), i.value()); // fetched while scanning
+        }
+
+        m_entries = found;
+        m_totalBytes = 0;
+        for (i = m_entries.constBegin(); i != m_entries.constEnd(); ++i)
+            m_totalBytes += i.value().size;
+        m_scanned = true;
+
+        qDebug() << "XPNetCacheManager::evict files=" << m_entries.count()
+                 << "bytes=" << m_totalBytes << "quota=" << m_quota;
+
+        if (m_totalBytes <= m_quota)
+            return;
+
+        // Oldest first
+        QList<QPair<qint64, QString> > byAge;
+        for (i = m_entries.constBegin(); i != m_entries.constEnd(); ++i)
+            byAge.append(qMakePair(i.value().lastAccess, i.key()));
+        qSort(byAge);
+
+        qint64 target = m_quota / 100 * XPNETCACHEMANAGER_LOW_WATERMARK;
+        qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+        // Packed files not used this session go first, they are not lost
+        for (int j=0, n=byAge.count(); j<n && m_totalBytes > target; j++)
+        {
+            const QString& path = byAge.at(j).second;
+
+            if (!packed.contains(path) || byAge.at(j).first >= m_sessionStart || m_pinned.contains(path))
+                continue;
+
+            m_totalBytes -= m_entries.value(path).size;
+            m_entries.remove(path);
+            drops.append(path);
+        }
+
+        for (int j=0, n=byAge.count(); j<n && m_totalBytes > target; j++)
+        {
+            const QString& path = byAge.at(j).second;
+
+            // Dropped above
+            if (!m_entries.contains(path))
+                continue;
+
+            // Opened in an editor since the scan
+            if (m_pinned.contains(path))
+                continue;
+
+            // A recent partial download may still be resumed
+            if (path.endsWith(XPNETFILE_PARTSUFFIX) && now - byAge.at(j).first < XPNETCACHEMANAGER_PART_AGE*1000LL)
+                continue;
+
+            m_totalBytes -= m_entries.value(path).size;
+            m_entries.remove(path);
+            victims.append(path);
+        }
+        m_evictions += victims.count();
+    }
+
+    // Remove the loose copies the pack holds and the evicted files with
+    // their ETag records
+    //
+    for (int j=0, n=drops.count(); j<n; j++)
+        QFile::remove(drops.at(j));
+
+    for (int j=0, n=victims.count(); j<n; j++)
+    {
+        QFile::remove(victims.at(j));
+        XPNetEtagIndex::instance()->remove(victims.at(j));
+        pack->remove(victims.at(j));
+    }
+    if (!victims.isEmpty())
+        pack->compact();
+
+    qDebug() << "XPNetCacheManager::evict removed=" << victims.count() << "dropped packed=" << drops.count()
+             << "bytes=" << totalBytes();
+}
+
+// End of file
@@ -0,0 +1,104 @@
+// This module defines the cache manager of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#ifndef XPNETCACHEMANAGER_H
+#define XPNETCACHEMANAGER_H
+
+#include <QSet>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+
+#define XPNETCACHEMANAGER_QUOTA_KEY "net-cache/quotaMB"
+#define XPNETCACHEMANAGER_DEFAULT_QUOTA 256 // MB
+#define XPNETCACHEMANAGER_LOW_WATERMARK 90 // percent of the quota left after evicting
+#define XPNETCACHEMANAGER_PART_AGE (24*3600) // seconds before an unfinished download may go
+
+
+/*
+ * Keeps the cache root under its quota by evicting the least
+ * recently used files on a background thread
+ */
+
+class XPNetCacheManager : public QThread
+{
+    Q_OBJECT
+
+public:
+    static XPNetCacheManager *instance();
+    static XPNetCacheManager *existingInstance(); // 0 until instance() was called
+
+    // A cached file was served (hit) or fetched from the hub (miss)
+    void recordHit(const QString& localPath);
+    void recordMiss(const QString& localPath);
+
+    // Scan the cache and evict in the background if over quota
+    void requestEviction();
+
+    // Keep a file open in an editor out of eviction
+    void pin(const QString& localPath);
+    void unpin(const QString& localPath);
+
+    quint64 hits();
+    quint64 misses();
+    quint64 evictions();
+    qint64 totalBytes();
+    qint64 quota() { return m_quota; }
+    QString cacheRoot() { return m_cacheRoot; }
+
+protected:
+    virtual void run();
+
+private:
+    struct Entry
+    {
+        qint64 size;
+        qint64 lastAccess; // msecs since the epoch
+    };
+
+    explicit XPNetCacheManager(const QString& cacheRoot);
+    ~XPNetCacheManager();
+    //
+    void evict();
+    void touch(const QString& localPath, bool fetched);
+    bool isManaged(const QString& localPath);
+
+private:
+    static XPNetCacheManager *m_instance; // this is a singleton
+    static QMutex m_instanceMutex;
+    //
+    QMutex m_mutex;
+    QString m_cacheRoot;
+    qint64 m_quota;
+    qint64 m_totalBytes;
+    bool m_scanned;
+    bool m_evicting;
+    bool m_evictRequested;
+    qint64 m_sessionStart; // msecs since the epoch
+    QHash<QString, Entry> m_entries; // absolute local path
+    QSet<QString> m_pinned; // absolute local path
+    //
+    quint64 m_hits;
+    quint64 m_misses;
+    quint64 m_evictions;
+};
+
+#endif // XPNETCACHEMANAGER_H
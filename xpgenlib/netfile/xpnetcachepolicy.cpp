@@ -0,0 +1,248 @@
+// This module implements the cache policy of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#include <QDebug>
+#include <QSettings>
+#include <QStringList>
+#include <QMutexLocker>
+
+#include "xpnetfile.h"
+#include "xpnetpool.h"
+#include "xpprivategetworker.h"
+#include "xpnetcachepolicy.h"
+
+// NOTES:
+// 1. Validation times are kept in memory, a new session asks the hub again.
+// 2. Each path class has a fresh window and a stale window after it,
+//    files outside both are checked with the hub before being served.
+// 3. Paths without a class are always checked. The RML under profiles/
+//    is left without one on purpose so it is never served stale.
+// 4. Classes can be overridden with the "net-cache/freshness" setting,
+//    a list of "prefix=fresh:stale" entries in seconds.
+// 5. Background revalidations are plain get workers nobody waits for.
+// 6. URLs the hub answered 404 or 410 for are not asked for again until
+//    XPNETCACHEPOLICY_MISSING_TTL has passed or the hub reports a change.
+//
+
+/* Static class variables
+ */
+
+XPNetCachePolicy *XPNetCachePolicy::m_instance = 0;
+QMutex XPNetCachePolicy::m_instanceMutex;
+
+
+XPNetCachePolicy *XPNetCachePolicy::instance()
+{
+    QMutexLocker locker(&m_instanceMutex);
+
+    if (m_instance == 0)
+        m_instance = new XPNetCachePolicy;
+
+    return m_instance;
+}
+
+XPNetCachePolicy::XPNetCachePolicy()
+{
+    m_clock.start();
+
+    // Hub metadata that changes rarely
+    addPathClass("categories/categories.index", 60, 3600);
+    addPathClass("categories/", 3600, 24*3600);
+
+    loadSettings();
+}
+
+void XPNetCachePolicy::loadSettings()
+{
+    QSettings settings;
+    QStringList entries = settings.value(XPNETCACHEPOLICY_SETTINGS_KEY).toStringList();
+
+    for (int i=0, n=entries.count(); i<n; i++)
+    {
+        // prefix=fresh:stale
+        QStringList tokens = entries.at(i).split('=');
+        QStringList windows = (tokens.count() == 2) ? tokens.at(1).split(':') : QStringList();
+        if (windows.count() != 2)
+        {
+            qDebug() << "XPNetCachePolicy::loadSettings bad entry=" << entries.at(i);
+            continue;
+        }
+
+        addPathClass(tokens.at(0), windows.at(0).toInt(), windows.at(1).toInt());
+    }
+}
+
+void XPNetCachePolicy::addPathClass(const QString& prefix, int fresh, int stale)
+{
+    // Replace an existing class, otherwise keep the longest prefixes first
+    int i = 0;
+    for (int n=m_classes.count(); i<n; i++)
+    {
+        if (m_classes.at(i).prefix == prefix)
+        {
+            m_classes.removeAt(i);
+            break;
+        }
+    }
+    for (i=0; i<m_classes.count() && m_classes.at(i).prefix.length() >= prefix.length(); i++)
+        ;
+
+    PathClass pathClass;
+    pathClass.prefix = prefix;
+    pathClass.fresh = qMax(fresh, 0);
+    pathClass.stale = qMax(stale, 0);
+    m_classes.insert(i, pathClass);
+}
+
+const XPNetCachePolicy::PathClass *XPNetCachePolicy::pathClass(const QString& urlPath)
+{
+    // Match below the web prefix
+    QString path = urlPath;
+    QString webPrefix = QString(XPNETFILE_WEBPREFIX);
+    if (path.startsWith(webPrefix))
+        path = path.mid(webPrefix.length());
+    while (path.startsWith('/'))
+        path = path.mid(1);
+
+    for (int i=0, n=m_classes.count(); i<n; i++)
+    {
+        if (path.startsWith(m_classes.at(i).prefix))
+            return &m_classes.at(i);
+    }
+
+    return 0;
+}
+
+XPNetCachePolicy::Freshness XPNetCachePolicy::freshness(const QString& localPath, const QString& urlPath)
+{
+    QMutexLocker locker(&m_mutex);
+
+    const PathClass *pc = pathClass(urlPath);
+    QHash<QString, qint64>::const_iterator i = m_validated.constFind(localPath);
+    if (pc == 0 || i == m_validated.constEnd())
+        return Expired;
+
+    qint64 age = m_clock.elapsed() - i.value();
+    if (age < pc->fresh*1000LL)
+        return Fresh;
+    if (age < (pc->fresh + pc->stale)*1000LL)
+        return Stale;
+
+    return Expired;
+}
+
+void XPNetCachePolicy::setValidated(const QString& localPath)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_validated.insert(localPath, m_clock.elapsed());
+    m_revalidating.remove(localPath);
+}
+
+void XPNetCachePolicy::expire(const QString& localPath)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_validated.remove(localPath);
+}
+
+void XPNetCachePolicy::invalidate()
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_validated.clear();
+    m_missing.clear();
+}
+
+bool XPNetCachePolicy::isMissing(const QUrl& url)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QHash<QString, qint64>::iterator i = m_missing.find(url.toString());
+    if (i == m_missing.end())
+        return false;
+
+    if (m_clock.elapsed() - i.value() >= XPNETCACHEPOLICY_MISSING_TTL*1000LL)
+    {
+        m_missing.erase(i);
+        return false;
+    }
+
+    return true;
+}
+
+void XPNetCachePolicy::setMissing(const QUrl& url)
+{
+    QMutexLocker locker(&m_mutex);
+
+    // Keep the table bounded, expired entries go first
+    qint64 now = m_clock.elapsed();
+    if (m_missing.count() >= XPNETCACHEPOLICY_MISSING_MAX)
+    {
+        QHash<QString, qint64>::iterator i = m_missing.begin();
+        while (i != m_missing.end())
+        {
+            if (now - i.value() >= XPNETCACHEPOLICY_MISSING_TTL*1000LL)
+                i = m_missing.erase(i);
+            else
+                ++i;
+        }
+        if (m_missing.count() >= XPNETCACHEPOLICY_MISSING_MAX)
+            m_missing.clear();
+    }
+
+    m_missing.insert(url.toString(), now);
+}
+
+void XPNetCachePolicy::clearMissing()
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_missing.clear();
+}
+
+void XPNetCachePolicy::clearMissing(const QUrl& url)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_missing.remove(url.toString());
+}
+
+void XPNetCachePolicy::revalidate(const QUrl& url, const QString& localPath)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+
+        // A revalidation that never reported back is retried after a while
+        qint64 now = m_clock.elapsed();
+        QHash<QString, qint64>::const_iterator i = m_revalidating.constFind(localPath);
+        if (i != m_revalidating.constEnd() && now - i.value() < XPNETCACHEPOLICY_REVALIDATE_TIMEOUT*1000LL)
+            return;
+        m_revalidating.insert(localPath, now);
+    }
+
+    qDebug() << "XPNetCachePolicy::revalidate stale file=" << localPath;
+
+    // The worker updates the cache and the validation time when it is done,
+    // the stale copy has been served so nobody waits for it
+    XPNetPool::instance()->start(new XPPrivateGetWorker(url, localPath), url, XPNetPool::Background);
+}
+
+// End of file
@@ -0,0 +1,93 @@
+// This module defines the cache policy of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#ifndef XPNETCACHEPOLICY_H
+#define XPNETCACHEPOLICY_H
+
+#include <QUrl>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QElapsedTimer>
+
+#define XPNETCACHEPOLICY_SETTINGS_KEY "net-cache/freshness"
+#define XPNETCACHEPOLICY_REVALIDATE_TIMEOUT 30 // seconds before a lost revalidation is retried
+#define XPNETCACHEPOLICY_MISSING_TTL 300 // seconds a missing hub file is not asked for
+#define XPNETCACHEPOLICY_MISSING_MAX 4096
+
+
+class XPNetCachePolicy
+{
+public:
+    enum Freshness
+    {
+        Fresh,  // serve the cached file
+        Stale,  // serve the cached file and revalidate in the background
+        Expired // ask the hub before serving
+    };
+
+    static XPNetCachePolicy *instance();
+
+    // How fresh the cached file is, urlPath selects its path class
+    Freshness freshness(const QString& localPath, const QString& urlPath);
+    // The hub has just confirmed the cached file (200 or 304)
+    void setValidated(const QString& localPath);
+    // The hub has a newer version than the cached file
+    void expire(const QString& localPath);
+    // Forget every validation and missing file, the next lookups ask the hub
+    void invalidate();
+
+    // The hub recently had no file at the URL (404 or 410)
+    bool isMissing(const QUrl& url);
+    void setMissing(const QUrl& url);
+    void clearMissing();
+    void clearMissing(const QUrl& url);
+
+    // Fetch the file in the background unless that is already happening
+    void revalidate(const QUrl& url, const QString& localPath);
+
+private:
+    struct PathClass
+    {
+        QString prefix; // URL path below the web prefix
+        int fresh;      // seconds served without asking the hub
+        int stale;      // further seconds served while revalidating
+    };
+
+    XPNetCachePolicy();
+    //
+    void loadSettings();
+    void addPathClass(const QString& prefix, int fresh, int stale);
+    const PathClass *pathClass(const QString& urlPath);
+
+private:
+    static XPNetCachePolicy *m_instance; // this is a singleton
+    static QMutex m_instanceMutex;
+    //
+    QMutex m_mutex;
+    QElapsedTimer m_clock;
+    QList<PathClass> m_classes; // longest prefix first
+    QHash<QString, qint64> m_validated; // local path, m_clock time
+    QHash<QString, qint64> m_revalidating; // local path, m_clock time
+    QHash<QString, qint64> m_missing; // URL string, m_clock time
+};
+
+#endif // XPNETCACHEPOLICY_H
@@ -0,0 +1,300 @@
+// This module implements the delta encoding of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#include <string.h>
+
+#include <QDebug>
+#include <QDataStream>
+#include <QCryptographicHash>
+
+#include "xpnetdelta.h"
+
+// NOTES:
+// 1. The base is cut into fixed blocks, each with the rsync rolling
+//    checksum and an MD5.
+// 2. The diff rolls the checksum over the target a byte at a time and
+//    emits runs of matched base blocks or literal bytes.
+// 3. Patch layout (big endian):
+//      magic, blockSize:4, baseSize:8, targetSize:8, base MD5:16,
+//      ops: 'C' first:4 count:4 | 'L' len:4 bytes | 'E',
+//      target MD5:16
+// 4. apply() checks both MD5s so a patch is never applied to the
+//    wrong base or produces a damaged file.
+//
+
+#define XPNETDELTA_OP_COPY 'C'
+#define XPNETDELTA_OP_LITERAL 'L'
+#define XPNETDELTA_OP_END 'E'
+
+#define XPNETDELTA_MAGIC_SIZE ((int)(sizeof(XPNETDELTA_MAGIC)-1))
+#define XPNETDELTA_HASH_SIZE 16
+
+
+static void writeCopy(QDataStream& out, int& first, int& count)
+{
+    if (count == 0)
+        return;
+
+    out << (quint8)XPNETDELTA_OP_COPY << (quint32)first << (quint32)count;
+    first = -1;
+    count = 0;
+}
+
+static void writeLiteral(QDataStream& out, const char *data, int len)
+{
+    if (len == 0)
+        return;
+
+    out << (quint8)XPNETDELTA_OP_LITERAL << (quint32)len;
+    out.writeRawData(data, len);
+}
+
+
+bool XPNetDelta::computeSignature(QIODevice *base, int blockSize)
+{
+    m_blockSize = blockSize;
+    m_baseSize = -1;
+    m_weak.clear();
+    m_strong.clear();
+    m_baseHash.clear();
+
+    if (!base->isReadable() || blockSize <= 0)
+        return false;
+
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    QByteArray block(blockSize, 0);
+    qint64 size = 0;
+
+    forever
+    {
+        // Fill a whole block, the device may return less
+        int len = 0;
+        while (len < blockSize)
+        {
+            qint64 n = base->read(block.data()+len, blockSize-len);
+            if (n <= 0)
+                break;
+            len += n;
+        }
+        if (len == 0)
+            break;
+
+        hash.addData(block.constData(), len);
+        size += len;
+
+        // Only whole blocks can be matched, a short tail goes as literal
+        if (len == blockSize)
+        {
+            m_weak.insert(checksum(reinterpret_cast<const uchar *>(block.constData()), len), m_strong.count());
+            m_strong.append(strongHash(block.constData(), len));
+        }
+        if (len < blockSize)
+            break;
+    }
+
+    m_baseHash = hash.result();
+    m_baseSize = size;
+
+    return true;
+}
+
+QByteArray XPNetDelta::diff(QIODevice *target)
+{
+    QByteArray data = target->readAll();
+    const uchar *p = reinterpret_cast<const uchar *>(data.constData());
+    int n = data.size();
+    int bs = m_blockSize;
+
+    QByteArray patch;
+    QDataStream out(&patch, QIODevice::WriteOnly);
+    out.writeRawData(XPNETDELTA_MAGIC, XPNETDELTA_MAGIC_SIZE);
+    out << (quint32)bs << (quint64)m_baseSize << (quint64)n;
+    out.writeRawData(m_baseHash.constData(), XPNETDELTA_HASH_SIZE);
+
+    int literalStart = 0;
+    int copyFirst = -1;
+    int copyCount = 0;
+    quint32 a = 0, b = 0;
+    bool rolling = false;
+
+    for (int i=0; i+bs <= n; )
+    {
+        if (!rolling)
+        {
+            quint32 weak = checksum(p+i, bs);
+            a = weak & 0xffff;
+            b = weak >> 16;
+            rolling = true;
+        }
+
+        // Look the window up, the MD5 is only computed for candidates
+        int match = -1;
+        quint32 weak = a | (b << 16);
+        QMultiHash<quint32, int>::const_iterator it = m_weak.constFind(weak);
+        if (it != m_weak.constEnd())
+        {
+            QByteArray strong = strongHash(data.constData()+i, bs);
+            for (; it != m_weak.constEnd() && it.key() == weak; ++it)
+            {
+                if (m_strong.at(it.value()) == strong)
+                {
+                    match = it.value();
+                    break;
+                }
+            }
+        }
+
+        if (match >= 0)
+        {
+            if (i > literalStart)
+            {
+                writeCopy(out, copyFirst, copyCount);
+                writeLiteral(out, data.constData()+literalStart, i-literalStart);
+            }
+
+            // Extend the current run of base blocks if possible
+            if (copyCount > 0 && copyFirst+copyCount != match)
+                writeCopy(out, copyFirst, copyCount);
+            if (copyCount == 0)
+                copyFirst = match;
+            copyCount++;
+
+            i += bs;
+            literalStart = i;
+            rolling = false;
+        }
+        else
+        {
+            // Slide the window one byte
+            if (i+bs < n)
+            {
+                a = (a - p[i] + p[i+bs]) & 0xffff;
+                b = (b - (quint32)bs*p[i] + a) & 0xffff;
+            }
+            i++;
+        }
+    }
+
+    writeCopy(out, copyFirst, copyCount);
+    writeLiteral(out, data.constData()+literalStart, n-literalStart);
+    out << (quint8)XPNETDELTA_OP_END;
+    out.writeRawData(strongHash(data.constData(), n).constData(), XPNETDELTA_HASH_SIZE);
+
+    return patch;
+}
+
+QByteArray XPNetDelta::apply(const QByteArray& base, const QByteArray& patch, bool *ok)
+{
+    if (ok)
+        *ok = false;
+
+    QDataStream in(patch);
+    char magic[XPNETDELTA_MAGIC_SIZE];
+    if (in.readRawData(magic, XPNETDELTA_MAGIC_SIZE) != XPNETDELTA_MAGIC_SIZE
+        || memcmp(magic, XPNETDELTA_MAGIC, XPNETDELTA_MAGIC_SIZE) != 0)
+        return QByteArray();
+
+    quint32 bs;
+    quint64 baseSize, targetSize;
+    QByteArray baseHash(XPNETDELTA_HASH_SIZE, 0);
+    in >> bs >> baseSize >> targetSize;
+    in.readRawData(baseHash.data(), XPNETDELTA_HASH_SIZE);
+
+    // The patch must have been made against this base
+    if (in.status() != QDataStream::Ok || bs == 0 || baseSize != (quint64)base.size()
+        || strongHash(base.constData(), base.size()) != baseHash)
+    {
+        qDebug() << "XPNetDelta::apply patch does not match the base";
+        return QByteArray();
+    }
+
+    QByteArray target;
+    target.reserve(targetSize);
+
+    forever
+    {
+        quint8 op;
+        in >> op;
+        if (in.status() != QDataStream::Ok)
+            return QByteArray();
+
+        if (op == XPNETDELTA_OP_COPY)
+        {
+            quint32 first, count;
+            in >> first >> count;
+            qint64 start = (qint64)first*bs;
+            qint64 end = qMin(start + (qint64)count*bs, (qint64)baseSize);
+            if (in.status() != QDataStream::Ok || start > end)
+                return QByteArray();
+            target.append(base.constData()+start, end-start);
+        }
+        else if (op == XPNETDELTA_OP_LITERAL)
+        {
+            quint32 len;
+            in >> len;
+            if (in.status() != QDataStream::Ok || len > (quint64)in.device()->bytesAvailable())
+                return QByteArray();
+            int offset = target.size();
+            target.resize(offset + len);
+            in.readRawData(target.data()+offset, len);
+        }
+        else if (op == XPNETDELTA_OP_END)
+        {
+            break;
+        }
+        else
+        {
+            return QByteArray();
+        }
+    }
+
+    QByteArray targetHash(XPNETDELTA_HASH_SIZE, 0);
+    in.readRawData(targetHash.data(), XPNETDELTA_HASH_SIZE);
+    if ((quint64)target.size() != targetSize || strongHash(target.constData(), target.size()) != targetHash)
+    {
+        qDebug() << "XPNetDelta::apply result does not match the target";
+        return QByteArray();
+    }
+
+    if (ok)
+        *ok = true;
+
+    return target;
+}
+
+quint32 XPNetDelta::checksum(const uchar *data, int len)
+{
+    quint32 a = 0, b = 0;
+
+    for (int i=0; i<len; i++)
+    {
+        a += data[i];
+        b += (quint32)(len-i)*data[i];
+    }
+
+    return (a & 0xffff) | ((b & 0xffff) << 16);
+}
+
+QByteArray XPNetDelta::strongHash(const char *data, int len)
+{
+    return QCryptographicHash::hash(QByteArray::fromRawData(data, len), QCryptographicHash::Md5);
+}
+
+// End of file
@@ -0,0 +1,67 @@
+// This module defines the delta encoding of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#ifndef XPNETDELTA_H
+#define XPNETDELTA_H
+
+#include <QHash>
+#include <QVector>
+#include <QIODevice>
+#include <QByteArray>
+
+#define XPNETDELTA_MAGIC "XPDELTA1"
+#define XPNETDELTA_CONTENTTYPE "application/x-xpdelta"
+#define XPNETDELTA_BLOCKSIZE 1024
+#define XPNETDELTA_MAXRATIO 75 // percent of the file size a patch may take
+
+
+/*
+ * rsync style delta: block signatures of a base file, a patch that
+ * turns the base into a target file and the reference patch apply
+ */
+
+class XPNetDelta
+{
+public:
+    XPNetDelta() : m_blockSize(XPNETDELTA_BLOCKSIZE), m_baseSize(-1) {}
+
+    // Signatures of the version the hub holds
+    bool computeSignature(QIODevice *base, int blockSize = XPNETDELTA_BLOCKSIZE);
+    bool isValid() { return m_baseSize >= 0; }
+
+    // Patch turning the base into the target
+    QByteArray diff(QIODevice *target);
+
+    // Hub side of the exchange, empty result if the patch doesn't fit the base
+    static QByteArray apply(const QByteArray& base, const QByteArray& patch, bool *ok = 0);
+
+private:
+    static quint32 checksum(const uchar *data, int len);
+    static QByteArray strongHash(const char *data, int len);
+
+private:
+    int m_blockSize;
+    qint64 m_baseSize;
+    QMultiHash<quint32, int> m_weak; // rolling checksum, block index
+    QVector<QByteArray> m_strong;    // per block
+    QByteArray m_baseHash;
+};
+
+#endif // XPNETDELTA_H
@@ -0,0 +1,339 @@
+// This module implements the ETag index of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#include <string.h>
+
+#include <QDir>
+#include <QDebug>
+#include <QFileInfo>
+#include <QtEndian>
+#include <QMutexLocker>
+#include <QProcessEnvironment>
+
+#include "xpnetetagindex.h"
+#include "xpnetfileutil.h"
+
+// NOTES:
+// 1. One index file in the cache root holds the ETags of every cached file.
+// 2. The file is a log: magic, then records of
+//    [keyLen:4][tagLen:4][key][tag][size:8][modified:8][checksum:2],
+//    little endian. Size and time are the file's when it was the hub's
+//    version, a file saved over since then is no base for a patch.
+// 3. A tagLen of XPNETETAGINDEX_REMOVED marks a removed key, it has no
+//    tag, size or time. Records with size and time have the
+//    XPNETETAGINDEX_STAMPED bit set in tagLen, older ones without it
+//    still load and count as saved over.
+// 4. At startup the log is memory mapped and replayed into a hash table,
+//    a torn record left by a crash ends the replay and is cut off.
+// 5. Updates append one record, the log is compacted when mostly stale.
+//
+
+#define XPNETETAGINDEX_REMOVED 0xFFFFFFFF
+#define XPNETETAGINDEX_STAMPED 0x80000000
+#define XPNETETAGINDEX_HEADER_SIZE 8
+#define XPNETETAGINDEX_STAMP_SIZE 16
+#define XPNETETAGINDEX_CHECKSUM_SIZE 2
+#define XPNETETAGINDEX_SLACK (64*1024)
+
+#define XPNETETAGINDEX_MAGIC_SIZE ((qint64)(sizeof(XPNETETAGINDEX_MAGIC)-1))
+
+
+/* Static class variables
+ */
+
+XPNetEtagIndex *XPNetEtagIndex::m_instance = 0;
+QMutex XPNetEtagIndex::m_instanceMutex;
+
+
+static QByteArray makeRecord(const QString& key, const QByteArray& eTag, const QPair<qint64, qint64>& stamp,
+                             bool removed)
+{
+    QByteArray keyData = key.toUtf8();
+    QByteArray record(XPNETETAGINDEX_HEADER_SIZE, 0);
+    uchar *header = reinterpret_cast<uchar *>(record.data());
+
+    qToLittleEndian<quint32>(keyData.size(), header);
+    qToLittleEndian<quint32>(removed ? XPNETETAGINDEX_REMOVED : (eTag.size() | XPNETETAGINDEX_STAMPED), header+4);
+    record.append(keyData);
+    if (!removed)
+    {
+        uchar stampData[XPNETETAGINDEX_STAMP_SIZE];
+        qToLittleEndian<qint64>(stamp.first, stampData);
+        qToLittleEndian<qint64>(stamp.second, stampData+8);
+        record.append(eTag);
+        record.append(reinterpret_cast<const char *>(stampData), XPNETETAGINDEX_STAMP_SIZE);
+    }
+
+    uchar checksum[XPNETETAGINDEX_CHECKSUM_SIZE];
+    qToLittleEndian<quint16>(qChecksum(record.constData(), record.size()), checksum);
+    record.append(reinterpret_cast<const char *>(checksum), XPNETETAGINDEX_CHECKSUM_SIZE);
+
+    return record;
+}
+
+static qint64 recordSize(const QString& key, const QByteArray& eTag)
+{
+    return XPNETETAGINDEX_HEADER_SIZE + key.toUtf8().size() + eTag.size() + XPNETETAGINDEX_STAMP_SIZE
+        + XPNETETAGINDEX_CHECKSUM_SIZE;
+}
+
+
+XPNetEtagIndex *XPNetEtagIndex::instance()
+{
+    QMutexLocker locker(&m_instanceMutex);
+
+    if (m_instance == 0)
+    {
+        QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+        m_instance = new XPNetEtagIndex(env.value("XP_RDFCACHE_PATH", QDir::homePath()+"/xped"));
+    }
+
+    return m_instance;
+}
+
+XPNetEtagIndex::XPNetEtagIndex(const QString& cacheRoot)
+    : m_liveBytes(0)
+{
+    m_cacheRoot = QDir::cleanPath(QFileInfo(cacheRoot).absoluteFilePath());
+    load();
+}
+
+XPNetEtagIndex::~XPNetEtagIndex()
+{
+    m_file.close();
+}
+
+QString XPNetEtagIndex::key(const QString& localPath)
+{
+    QString path = QDir::cleanPath(QFileInfo(localPath).absoluteFilePath());
+    QString root = m_cacheRoot + "/";
+
+    // Files outside the cache keep their absolute path
+    if (path.startsWith(root))
+        return path.mid(root.length());
+
+    return path;
+}
+
+QByteArray XPNetEtagIndex::value(const QString& localPath)
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_etags.value(key(localPath));
+}
+
+void XPNetEtagIndex::setValue(const QString& localPath, const QByteArray& eTag, bool stamp)
+{
+    Stamp newStamp(-1, -1);
+    if (stamp)
+    {
+        QFileInfo fi(localPath);
+        if (fi.exists())
+            newStamp = Stamp(fi.size(), fi.lastModified().toMSecsSinceEpoch());
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    QString k = key(localPath);
+    QHash<QString, QByteArray>::iterator i = m_etags.find(k);
+    if (i != m_etags.end())
+    {
+        if (i.value() == eTag && !stamp)
+            newStamp = m_stamps.value(k, Stamp(-1, -1));
+        if (i.value() == eTag && m_stamps.value(k) == newStamp)
+            return; // nothing changed
+        m_liveBytes -= recordSize(k, i.value());
+    }
+
+    m_etags.insert(k, eTag);
+    m_stamps.insert(k, newStamp);
+    m_liveBytes += recordSize(k, eTag);
+    append(k, eTag, newStamp, false);
+}
+
+bool XPNetEtagIndex::isUnmodified(const QString& localPath)
+{
+    QFileInfo fi(localPath);
+
+    QMutexLocker locker(&m_mutex);
+
+    QHash<QString, Stamp>::const_iterator i = m_stamps.constFind(key(localPath));
+    if (i == m_stamps.constEnd() || i.value().first < 0)
+        return false;
+
+    return fi.exists() && fi.size() == i.value().first
+        && fi.lastModified().toMSecsSinceEpoch() == i.value().second;
+}
+
+void XPNetEtagIndex::remove(const QString& localPath)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QString k = key(localPath);
+    QHash<QString, QByteArray>::iterator i = m_etags.find(k);
+    if (i == m_etags.end())
+        return;
+
+    m_liveBytes -= recordSize(k, i.value());
+    m_etags.erase(i);
+    m_stamps.remove(k);
+    append(k, QByteArray(), Stamp(-1, -1), true);
+}
+
+void XPNetEtagIndex::load()
+{
+    QDir dir;
+    dir.mkpath(m_cacheRoot);
+
+    m_file.setFileName(QString("%1/%2").arg(m_cacheRoot).arg(XPNETETAGINDEX_FILENAME));
+    if (!m_file.open(QFile::ReadWrite))
+    {
+        qDebug() << "XPNetEtagIndex::load open error=" << m_file.errorString();
+        return;
+    }
+
+    // Replay the log straight out of the mapped file
+    //
+    qint64 fileSize = m_file.size();
+    qint64 validSize = 0;
+
+    uchar *data = (fileSize >= XPNETETAGINDEX_MAGIC_SIZE) ? m_file.map(0, fileSize) : 0;
+    if (data && memcmp(data, XPNETETAGINDEX_MAGIC, XPNETETAGINDEX_MAGIC_SIZE) == 0)
+    {
+        const uchar *p = data + XPNETETAGINDEX_MAGIC_SIZE;
+        const uchar *end = data + fileSize;
+        validSize = XPNETETAGINDEX_MAGIC_SIZE;
+
+        while (end - p >= XPNETETAGINDEX_HEADER_SIZE)
+        {
+            quint32 keyLen = qFromLittleEndian<quint32>(p);
+            quint32 tagLen = qFromLittleEndian<quint32>(p+4);
+            bool removed = (tagLen == XPNETETAGINDEX_REMOVED);
+            bool stamped = !removed && (tagLen & XPNETETAGINDEX_STAMPED);
+            if (removed)
+                tagLen = 0;
+            tagLen &= ~XPNETETAGINDEX_STAMPED;
+            qint64 stampSize = stamped ? XPNETETAGINDEX_STAMP_SIZE : 0;
+
+            // Stop at a torn or corrupt record
+            qint64 size = (qint64)XPNETETAGINDEX_HEADER_SIZE + keyLen + tagLen + stampSize + XPNETETAGINDEX_CHECKSUM_SIZE;
+            if (end - p < size)
+                break;
+            quint16 checksum = qFromLittleEndian<quint16>(p + size - XPNETETAGINDEX_CHECKSUM_SIZE);
+            if (qChecksum(reinterpret_cast<const char *>(p), size - XPNETETAGINDEX_CHECKSUM_SIZE) != checksum)
+                break;
+
+            const char *keyData = reinterpret_cast<const char *>(p + XPNETETAGINDEX_HEADER_SIZE);
+            QString k = QString::fromUtf8(keyData, keyLen);
+            if (removed)
+            {
+                m_etags.remove(k);
+                m_stamps.remove(k);
+            }
+            else
+            {
+                const uchar *stampData = p + XPNETETAGINDEX_HEADER_SIZE + keyLen + tagLen;
+                m_etags.insert(k, QByteArray(keyData + keyLen, tagLen));
+                if (stamped)
+                    m_stamps.insert(k, Stamp(qFromLittleEndian<qint64>(stampData), qFromLittleEndian<qint64>(stampData+8)));
+                else
+                    m_stamps.insert(k, Stamp(-1, -1));
+            }
+
+            p += size;
+            validSize += size;
+        }
+    }
+    if (data)
+        m_file.unmap(data);
+
+    // Start a new log or cut off a torn tail
+    if (validSize == 0)
+    {
+        m_file.resize(0);
+        m_file.write(XPNETETAGINDEX_MAGIC, XPNETETAGINDEX_MAGIC_SIZE);
+        m_file.flush();
+        validSize = XPNETETAGINDEX_MAGIC_SIZE;
+    }
+    else if (validSize < fileSize)
+    {
+        qDebug() << "XPNetEtagIndex::load dropped" << fileSize-validSize << "bytes of torn records";
+        m_file.resize(validSize);
+    }
+    m_file.seek(validSize);
+
+    QHash<QString, QByteArray>::const_iterator i;
+    for (i = m_etags.constBegin(); i != m_etags.constEnd(); ++i)
+        m_liveBytes += recordSize(i.key(), i.value());
+
+    qDebug() << "XPNetEtagIndex::load entries=" << m_etags.count() << "root=" << m_cacheRoot;
+
+    if (validSize > 2*m_liveBytes + XPNETETAGINDEX_SLACK)
+        compact();
+}
+
+void XPNetEtagIndex::append(const QString& key, const QByteArray& eTag, const Stamp& stamp, bool removed)
+{
+    if (!m_file.isOpen())
+        return;
+
+    // A single write so a crash leaves at most one torn record
+    m_file.write(makeRecord(key, eTag, stamp, removed));
+    m_file.flush();
+
+    if (m_file.pos() > 2*m_liveBytes + XPNETETAGINDEX_SLACK)
+        compact();
+}
+
+void XPNetEtagIndex::compact()
+{
+    // Write the live records to a new log and swap it in atomically
+    QFile newFile(m_file.fileName() + ".new");
+    if (!newFile.open(QFile::WriteOnly | QFile::Truncate))
+    {
+        qDebug() << "XPNetEtagIndex::compact open error=" << newFile.errorString();
+        return;
+    }
+
+    bool ok = newFile.write(XPNETETAGINDEX_MAGIC, XPNETETAGINDEX_MAGIC_SIZE) == XPNETETAGINDEX_MAGIC_SIZE;
+    QHash<QString, QByteArray>::const_iterator i;
+    for (i = m_etags.constBegin(); ok && i != m_etags.constEnd(); ++i)
+    {
+        QByteArray record = makeRecord(i.key(), i.value(), m_stamps.value(i.key(), Stamp(-1, -1)), false);
+        ok = newFile.write(record) == record.size();
+    }
+
+    // On the disk before the rename makes it the index
+    ok = ok && XPNetFileUtil::syncFile(newFile);
+    newFile.close();
+
+    m_file.close();
+    if (!ok || !XPNetFileUtil::replaceFile(newFile.fileName(), m_file.fileName()))
+    {
+        qDebug() << "XPNetEtagIndex::compact replace error=" << newFile.errorString();
+        QFile::remove(newFile.fileName());
+    }
+
+    // Carry on appending to whichever log is now in place
+    if (m_file.open(QFile::ReadWrite))
+        m_file.seek(m_file.size());
+}
+
+// End of file
@@ -0,0 +1,75 @@
+// This module defines the ETag index of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#ifndef XPNETETAGINDEX_H
+#define XPNETETAGINDEX_H
+
+#include <QHash>
+#include <QPair>
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <QByteArray>
+
+#define XPNETETAGINDEX_FILENAME ".xpetagindex"
+#define XPNETETAGINDEX_MAGIC "XPETAG01"
+
+
+class XPNetEtagIndex
+{
+public:
+    static XPNetEtagIndex *instance();
+
+    // Keys are local file paths, stored relative to the cache root. With
+    // stamp the file's size and time are taken as the hub's version,
+    // without it a record for the same tag keeps the ones it has
+    QByteArray value(const QString& localPath);
+    void setValue(const QString& localPath, const QByteArray& eTag, bool stamp = true);
+    void remove(const QString& localPath);
+
+    // The file still has the size and time it had when it was stamped
+    bool isUnmodified(const QString& localPath);
+
+    QString cacheRoot() { return m_cacheRoot; }
+    QString key(const QString& localPath);
+
+private:
+    typedef QPair<qint64, qint64> Stamp; // size and msecs modified, -1 when unknown
+
+    explicit XPNetEtagIndex(const QString& cacheRoot);
+    ~XPNetEtagIndex();
+    //
+    void load();
+    void append(const QString& key, const QByteArray& eTag, const Stamp& stamp, bool removed);
+    void compact();
+
+private:
+    static XPNetEtagIndex *m_instance; // this is a singleton
+    static QMutex m_instanceMutex;
+    //
+    QMutex m_mutex;
+    QString m_cacheRoot;
+    QFile m_file; // append only log
+    qint64 m_liveBytes;
+    QHash<QString, QByteArray> m_etags;
+    QHash<QString, Stamp> m_stamps;
+};
+
+#endif // XPNETETAGINDEX_H
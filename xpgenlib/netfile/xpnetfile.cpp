@@ -20,26 +20,50 @@
 
 #include <QDir>
 #include <QDebug>
-#include <QThread>
+#include <QTimer>
 #include <QFileInfo>
-#include <QNetworkRequest>
 #include <QEventLoop>
 
+#include "xpnetpool.h"
+#include "xpnetcachepolicy.h"
+#include "xpnetcachemanager.h"
+#include "xpnetmetrics.h"
+#include "xpnetpackstore.h"
+#include "xpnetetagindex.h"
+#include "xpnetfileutil.h"
 #include "xpprivategetworker.h"
+#include "xpprivateheadworker.h"
 #include "xpprivateputworker.h"
-//#include "xpprivatelistworker.h"
 #include "xpnetfile.h"
 
 // NOTES:
-// 1. Synchronous operation for open() and close().
-// 2. The caller will usually setup the URL for HTTP.
-// 3. Reading a file is possible after a successful call to open().
-// 4. Writing file to server happens after a successful call to close().
-// 5. Uses an ETAG to test whether local file is stale.
+// 1. Asynchronous operation for existsAsync(), closeAsync(), putAsync()
+//    and statAsync().
+// 2. Synchronous open(), close() and exists() wait for the asynchronous ones.
+// 3. Transfers run on the shared XPNetPool threads, finished() reports back.
+// 4. The caller will usually setup the URL for HTTP.
+// 5. Reading a file is possible after a successful call to open().
+// 6. Writing file to server happens after a successful call to close().
+// 7. Uses an ETAG to test whether local file is stale.
+// 8. Recently validated files are served from the cache without asking
+//    the hub, see XPNetCachePolicy for the freshness windows.
+// 9. Files the hub recently didn't have fail without a request.
+// 10. Opening for writing signs the cached hub version so close() can
+//     send a patch instead of the whole file.
+// 11. stat() asks for the metadata with HEAD, a fresh cached file or a
+//     known missing one answers without a request.
+// 12. Each operation runs at the file's priority, see XPNetPool.
+// 13. With the pack store on, a dropped cached file is written back from
+//     the pack before asking the hub.
+// 14. map() gives parsers the cached bytes in place, see XPNetFileView.
+// 15. Lookups the cache answers are counted in XPNetMetrics like transfers.
+// 16. Writes go to a side file that close() renames over the cached one,
+//     so a view mapping the cached file never sees it truncated.
 //
 
 XPNetFile::XPNetFile(const QUrl& url, const QString& localPath, QObject *parent)
-    : QFile(parent), m_url(url), m_localPath(localPath), m_open(false)
+    : QFile(parent), m_url(url), m_localPath(localPath), m_open(false), m_running(false), m_worker(0),
+      m_priority(XPNetPool::Normal), m_remoteSize(-1)
 {
     // Modify the URL to add the webserver prefix
     QString webPrefix = QString(XPNETFILE_WEBPREFIX);
@@ -53,6 +77,16 @@ XPNetFile::XPNetFile(const QUrl& url, const QString& localPath, QObject *parent)
 
 XPNetFile::~XPNetFile()
 {
+    // Workers outlive us so stop any transfer still in progress
+    if (m_running)
+        emit abortRequested();
+
+    // Never closed, the cached file stays as it was
+    if (m_open && (m_flags & QFile::WriteOnly))
+    {
+        QFile::close();
+        QFile::remove(m_localPath + XPNETFILE_SAVESUFFIX);
+    }
 }
 
 bool XPNetFile::open(OpenMode flags, int msecs)
@@ -69,41 +103,214 @@ bool XPNetFile::open(OpenMode flags, int msecs)
     {
         return false;
     }
+#ifdef XPNETFILE_USE_DELTA
+    else
+    {
+        // Sign the cached hub version before it is overwritten, a file
+        // saved over since it was fetched is no longer the hub's version
+        m_delta = XPNetDelta();
+        m_deltaETag.clear();
+        QFile base(m_localPath);
+        if (XPNetEtagIndex::instance()->isUnmodified(m_localPath) && base.open(QFile::ReadOnly))
+        {
+            m_deltaETag = XPNetEtagIndex::instance()->value(m_localPath);
+            m_delta.computeSignature(&base);
+        }
+    }
+#endif
 
-    // Open file as requested
+    // Open file as requested, writes start from a copy when they keep the content
     setFileName(m_localPath);
+    if (flags & QFile::WriteOnly)
+    {
+        QString savePath = m_localPath + XPNETFILE_SAVESUFFIX;
+        QFile::remove(savePath);
+        if ((flags & (QFile::ReadOnly | QFile::Append)) && !(flags & QFile::Truncate)
+            && QFile::exists(m_localPath) && !QFile::copy(m_localPath, savePath))
+        {
+            m_errorString = "Unable to copy local file";
+            return false;
+        }
+        setFileName(savePath);
+    }
     m_open = QFile::open(flags);
 
     return m_open;
 }
 
 bool XPNetFile::close(int msecs)
+{
+    closeAsync();
+    return waitForFinished(msecs);
+}
+
+bool XPNetFile::exists(int msecs)
+{
+    existsAsync();
+    return waitForFinished(msecs);
+}
+
+bool XPNetFile::map(XPNetFileView& view, int msecs)
+{
+    if (!exists(msecs))
+        return false;
+
+    if (!view.map(m_localPath))
+    {
+        m_errorString = QString("Unable to map cached file=%1 error=%2").arg(m_localPath).arg(view.errorString());
+        return false;
+    }
+
+    return true;
+}
+
+bool XPNetFile::stat(int msecs)
+{
+    statAsync();
+    return waitForFinished(msecs);
+}
+
+bool XPNetFile::put(const QByteArray& data, int msecs)
+{
+    putAsync(data);
+    return waitForFinished(msecs);
+}
+
+bool XPNetFile::put(QIODevice *device, int msecs)
+{
+    if (device == 0 || !device->isReadable())
+    {
+        m_errorString = "Device is not open for reading";
+        return false;
+    }
+
+    // The rest of the device is copied into memory, the worker sends the copy
+    return put(device->readAll(), msecs);
+}
+
+void XPNetFile::putAsync(const QByteArray& data)
+{
+    // Only the URL is needed
+    m_errorString = "";
+    if (m_url.isEmpty() || !m_url.isValid())
+    {
+        finishLater("File URL is empty or invalid");
+        return;
+    }
+
+    qDebug() << "XpNetFile put from memory started... size=" << data.size();
+
+    startWorker(new XPPrivatePutWorker(m_url, data));
+}
+
+void XPNetFile::statAsync()
+{
+    m_remoteSize = -1;
+    m_remoteETag.clear();
+    m_remoteLastModified = QDateTime();
+
+    // Only the URL is needed, the local path links the cached file
+    m_errorString = "";
+    if (m_url.isEmpty() || !m_url.isValid())
+    {
+        finishLater("File URL is empty or invalid");
+        return;
+    }
+
+#ifdef XPNETFILE_USE_ETAG
+    XPNetCachePolicy *policy = XPNetCachePolicy::instance();
+    if (policy->isMissing(m_url))
+    {
+        XPNetMetrics::instance()->record("HEAD", m_url, 0, XPNetMetrics::LocalMiss, 0, 0, -1, 0, 0);
+        finishLater("File not found on hub");
+        return;
+    }
+
+    // A fresh cached file answers for the hub, without Last-Modified
+    QFileInfo fi(m_localPath);
+    QByteArray eTag = m_localPath.isEmpty() ? QByteArray() : XPNetEtagIndex::instance()->value(m_localPath);
+    if (!eTag.isEmpty() && fi.exists() && policy->freshness(m_localPath, m_url.path()) == XPNetCachePolicy::Fresh)
+    {
+        m_remoteSize = fi.size();
+        m_remoteETag = eTag;
+        XPNetMetrics::instance()->record("HEAD", m_url, 0, XPNetMetrics::LocalHit, 0, 0, -1, 0, 0);
+        finishLater();
+        return;
+    }
+#endif
+
+    qDebug() << "XpNetFile stat started...";
+
+    XPPrivateHeadWorker *worker = new XPPrivateHeadWorker(m_url, m_localPath);
+    connect(worker, SIGNAL(statReady(qint64,QByteArray,QDateTime)), this, SLOT(onStatReady(qint64,QByteArray,QDateTime)));
+    startWorker(worker);
+}
+
+void XPNetFile::closeAsync()
 {
     // Must have opened first
     if (!m_open)
-        return true;
+    {
+        finishLater();
+        return;
+    }
 
     QFile::close();
     m_open = false;
 
     // ReadOnly operations simply close the file
     if (!(m_flags & QFile::WriteOnly))
-        return true;
+    {
+        finishLater();
+        return;
+    }
+
+    // The written file becomes the cached one
+    QString savePath = fileName();
+    setFileName(m_localPath);
+    if (!XPNetFileUtil::replaceFile(savePath, m_localPath))
+    {
+        QFile::remove(savePath);
+        finishLater(QString("Unable to replace cached file=%1").arg(m_localPath));
+        return;
+    }
 
     // WriteOnly and ReadWrite operations send local file to remote host
-    return putToServer(msecs);
+    putToServer();
 }
 
-bool XPNetFile::exists(int msecs)
+void XPNetFile::existsAsync()
 {
     QFileInfo fi(m_localPath);
 
+    // A packed copy of the same version is as good as the cached file
+    if (!fi.exists() && !m_localPath.isEmpty() && XPNetPackStore::instance()->extract(m_localPath))
+        fi.refresh();
+
 #ifndef XPNETFILE_USE_ETAG
     // Return straight away if already cached
     if (fi.exists())
     {
         qDebug() << "Local file exists =" << fi.fileName();
-        return true;
+        finishLater();
+        return;
+    }
+#else
+    XPNetCachePolicy *policy = XPNetCachePolicy::instance();
+
+    // Serve a recently validated file, revalidate it if it went stale
+    if (fi.exists() && validateUrl())
+    {
+        XPNetCachePolicy::Freshness freshness = policy->freshness(m_localPath, m_url.path());
+        if (freshness != XPNetCachePolicy::Expired)
+        {
+            if (freshness == XPNetCachePolicy::Stale)
+                policy->revalidate(m_url, m_localPath);
+            XPNetCacheManager::instance()->recordHit(m_localPath);
+            XPNetMetrics::instance()->record("GET", m_url, 0, XPNetMetrics::LocalHit, 0, 0, -1, 0, 0);
+            finishLater();
+            return;
+        }
     }
 #endif
 
@@ -111,56 +318,41 @@ bool XPNetFile::exists(int msecs)
     if (!validateUrl())
     {
         qDebug() << "URL is invalid";
-        return false;
+        finishLater(m_errorString);
+        return;
+    }
+
+#ifdef XPNETFILE_USE_ETAG
+    // The hub had no such file a moment ago
+    if (policy->isMissing(m_url))
+    {
+        qDebug() << "Known missing on hub =" << m_url;
+        XPNetMetrics::instance()->record("GET", m_url, 0, XPNetMetrics::LocalMiss, 0, 0, -1, 0, 0);
+        finishLater("File not found on hub");
+        return;
     }
+#endif
 
     // Create the cache path since it may not exist
     QDir dir;
     if (!dir.mkpath(fi.path()))
     {
-        m_errorString = QString("Unable to create cache path=%1").arg( fi.path());
-        return false;
+        finishLater(QString("Unable to create cache path=%1").arg(fi.path()));
+        return;
     }
 
-    // >>> EXEC REQUEST IN A SEPARATE THREAD TO LET THIS ONE BLOCK
-    //
-    QThread *workerThread = new QThread;
-    XPPrivateGetWorker *worker = new XPPrivateGetWorker(this);
-    worker->moveToThread(workerThread);
-    connect(this, SIGNAL(operate()), worker, SLOT(doWork()));
-    connect(workerThread, SIGNAL(finished()), workerThread, SLOT(deleteLater()));
-
-    emit operate();
-    workerThread->start();
-    //
-    // <<< EXEC REQUEST IN A SEPARATE THREAD TO LET THIS ONE BLOCK
-
-    // Wait here for worker to finish
-    //
-    qDebug() << "XpNetFile exists waiting...";
-    //
-    QEventLoop loop;
-    connect(worker, SIGNAL(finished()), &loop, SLOT(quit()));
-    loop.exec();
-    //
-    qDebug() << "XpNetFile exists woken";
-
-    m_errorString = worker->errorString();
-    bool ok = m_errorString.isEmpty() ? true : false;
-
-    // Get rid of thread and worker
-    workerThread->quit();
-    worker->deleteLater();
-
-    return ok;
+    qDebug() << "XpNetFile exists started...";
+
+    startWorker(new XPPrivateGetWorker(m_url, m_localPath));
 }
 
-bool XPNetFile::putToServer(int msecs)
+void XPNetFile::putToServer()
 {
     if (!validateUrl())
     {
         qDebug() << "URL is invalid";
-        return true;
+        finishLater();
+        return;
     }
 
     // Make sure file exists and is not empty
@@ -168,115 +360,122 @@ bool XPNetFile::putToServer(int msecs)
     if (!fi.exists() || fi.size() == 0)
     {
         qDebug() << "Local file does not exist or is empty";
-        return false;
+        finishLater("Local file does not exist or is empty");
+        return;
     }
 
-    // >>> EXEC REQUEST IN A SEPARATE THREAD TO LET THIS ONE BLOCK
-    //
-    QThread *workerThread = new QThread;
-    XPPrivatePutWorker *worker = new XPPrivatePutWorker(this);
-    worker->moveToThread(workerThread);
-    connect(this, SIGNAL(operate()), worker, SLOT(doWork()));
-    connect(workerThread, SIGNAL(finished()), workerThread, SLOT(deleteLater()));
-
-    emit operate();
-    workerThread->start();
-    //
-    // <<< EXEC REQUEST IN A SEPARATE THREAD TO LET THIS ONE BLOCK
-
-    // Wait here for worker to finish
-    //
-    qDebug() << "XpNetFile put waiting...";
-    //
-    m_mutex.lock();
-    int ok = m_workComplete.wait(&m_mutex, msecs);
-    m_mutex.unlock();
-    //
-    qDebug() << "XpNetFile put woken";
-
-    if (!ok) // timed out
-        m_errorString = "Network transfer timed out";
-    else // woken
+    qDebug() << "XpNetFile put started...";
+
+    XPPrivatePutWorker *worker = new XPPrivatePutWorker(m_url, m_localPath);
+#ifdef XPNETFILE_USE_DELTA
+    worker->setDelta(m_delta, m_deltaETag);
+    m_delta = XPNetDelta();
+#endif
+    startWorker(worker);
+}
+
+void XPNetFile::invalidate()
+{
+    XPNetCachePolicy::instance()->expire(m_localPath);
+    XPNetCachePolicy::instance()->clearMissing(m_url);
+}
+
+XPNetBatch *XPNetFile::fetchMany(const QList<XPNetBatchItem>& items, int maxInFlight, QObject *parent,
+                                 XPNetPool::Priority priority)
+{
+    XPNetBatch *batch = new XPNetBatch(items, maxInFlight, parent, priority);
+    batch->start();
+
+    return batch;
+}
+
+bool XPNetFile::waitForFinished(int msecs)
+{
+    if (m_running)
     {
-        m_errorString = worker->errorString();
-        ok = m_errorString.isEmpty() ? true : false;
+        // Wait here for the worker to finish
+        //
+        qDebug() << "XpNetFile waiting...";
+        //
+        QTimer timer;
+        QEventLoop loop;
+        timer.setSingleShot(true);
+        connect(&timer, SIGNAL(timeout()), &loop, SLOT(quit()));
+        connect(this, SIGNAL(finished(bool)), &loop, SLOT(quit()));
+        timer.start(msecs);
+        loop.exec();
+        //
+        qDebug() << "XpNetFile woken";
+
+        if (m_running) // timed out
+        {
+            emit abortRequested();
+            m_running = false;
+            m_worker = 0;
+            m_errorString = "Network transfer timed out";
+        }
     }
 
-    // Get rid of thread and worker
-    workerThread->quit();
-    worker->deleteLater();
+    return m_errorString.isEmpty() ? true : false;
+}
+
+void XPNetFile::onWorkerFinished(QString errorString)
+{
+    // Ignore workers that were abandoned after a time out
+    if (!m_running || sender() != m_worker)
+        return;
+
+    m_running = false;
+    m_worker = 0;
+    m_errorString = errorString;
 
-    return ok;
+    emit finished(m_errorString.isEmpty());
 }
 
-bool XPNetFile::validateUrl()
+void XPNetFile::onStatReady(qint64 size, QByteArray eTag, QDateTime lastModified)
 {
-    // Clear last error
+    if (!m_running || sender() != m_worker)
+        return;
+
+    m_remoteSize = size;
+    m_remoteETag = eTag;
+    m_remoteLastModified = lastModified;
+}
+
+void XPNetFile::startWorker(QObject *worker)
+{
+    m_running = true;
+    m_worker = worker;
     m_errorString = "";
 
-    // Make sure URL is ok
-    if (m_localPath.isEmpty() || m_url.isEmpty() || !m_url.isValid())
-    {
-        m_errorString = "File local path or URL is empty or invalid";
-        return false;
-    }
+    // Both signals cross threads so they are queued
+    connect(worker, SIGNAL(finished(QString)), this, SLOT(onWorkerFinished(QString)));
+    connect(this, SIGNAL(abortRequested()), worker, SLOT(abort()));
 
-    return true;
+    XPNetPool::instance()->start(worker, m_url, m_priority);
 }
 
-#if 0
-QStringList XPNetFile::list(int msecs)
+void XPNetFile::finishLater(const QString& errorString)
 {
-    QStringList result;
+    // Report the result from the event loop like a real transfer
+    m_running = true;
+    m_worker = 0; // there is no sender for an invoked slot
+    QMetaObject::invokeMethod(this, "onWorkerFinished", Qt::QueuedConnection, Q_ARG(QString, errorString));
+}
 
+bool XPNetFile::validateUrl()
+{
     // Clear last error
     m_errorString = "";
 
     // Make sure URL is ok
-    if (m_url.isEmpty() || !m_url.isValid())
-    {
-        m_errorString = "File URL is empty or invalid";
-        return result;
-    }
-
-    // >>> EXEC REQUEST IN A SEPARATE THREAD TO LET THIS ONE BLOCK
-    //
-    QThread *workerThread = new QThread;
-    XPPrivateListWorker *worker = new XPPrivateListWorker(this);
-    worker->moveToThread(workerThread);
-    connect(this, SIGNAL(operate()), worker, SLOT(doWork()));
-    connect(workerThread, SIGNAL(finished()), workerThread, SLOT(deleteLater()));
-
-    emit operate();
-    workerThread->start();
-    //
-    // <<< EXEC REQUEST IN A SEPARATE THREAD TO LET THIS ONE BLOCK
-
-    // Wait here for worker to finish
-    //
-    qDebug() << "XpNetFile list waiting...";
-    //
-    m_mutex.lock();
-    int ok = m_workComplete.wait(&m_mutex, msecs);
-    m_mutex.unlock();
-    //
-    qDebug() << "XpNetFile list woken";
-
-    if (!ok) // timed out
-        m_errorString = "Network transfer timed out";
-    else // woken
+    if (m_localPath.isEmpty() || m_url.isEmpty() || !m_url.isValid())
     {
-        m_errorString = worker->errorString();
-        if (m_errorString.isEmpty())
-            result = worker->listItems();
+        m_errorString = "File local path or URL is empty or invalid";
+        return false;
     }
 
-    // Get rid of thread and worker
-    workerThread->quit();
-    worker->deleteLater();
-
-    return result;
+    return true;
 }
-#endif
 
 // End of file
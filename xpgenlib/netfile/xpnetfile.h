@@ -25,50 +25,109 @@
 
 #include <QUrl>
 #include <QFile>
+#include <QDateTime>
 #include <QList>
-#include <QMutex>
 #include <QStringList>
-#include <QWaitCondition>
+
+#include "xpnetpool.h"
+#include "xpnetbatch.h"
+#include "xpnetdelta.h"
+#include "xpnetfileview.h"
 
 #define XPNETFILE_USE_ETAG
+#define XPNETFILE_USE_GZIP // gzip encoded PUT, GET replies are always decoded
+#define XPNETFILE_GZIP_MINSIZE 1024
+#define XPNETFILE_USE_DELTA // PUT a patch against the cached hub version
 #define XPNETFILE_WEBPREFIX "/data"
+#define XPNETFILE_PARTSUFFIX ".part"
+#define XPNETFILE_SAVESUFFIX ".save" // written and renamed over the cached file
+#define XPNETFILE_SEGMENTS 4 // parallel ranges for large files, 1 to disable
+#define XPNETFILE_SEGMENT_MINSIZE (4*1024*1024)
 
 
 class XPGENLIBMOBILESHARED_EXPORT XPNetFile : public QFile
 {
     Q_OBJECT
 
-public:
-    // These are accessed directly by the worker thread
-    QUrl m_url;
-    QMutex m_mutex;
-    QWaitCondition m_workComplete;
-
 public:
     explicit XPNetFile(const QUrl& url, const QString& localPath, QObject *parent = 0);
     ~XPNetFile();
 
+    // Synchronous operations block until the transfer is finished
     bool open(OpenMode flags, int msecs = 30000);
     bool close(int msecs = 30000);
     bool exists(int msecs = 30000);
-    //QStringList list(int msecs = 30000);
+    bool stat(int msecs = 30000);
+
+    // Validate or fetch the cached file like exists() and map it read only
+    using QFile::map;
+    bool map(XPNetFileView& view, int msecs = 30000);
+
+    // Send data to the server straight from memory, no local file needed
+    bool put(const QByteArray& data, int msecs = 30000);
+    bool put(QIODevice *device, int msecs = 30000); // reads the rest of the device into a copy
+
+    // Asynchronous operations emit finished() when the transfer is done
+    void existsAsync();
+    void closeAsync();
+    void putAsync(const QByteArray& data);
+    void statAsync();
+
+    // Hub file metadata from the last successful stat()
+    qint64 remoteSize() { return m_remoteSize; }
+    QByteArray remoteETag() { return m_remoteETag; }
+    QDateTime remoteLastModified() { return m_remoteLastModified; }
+    bool isRunning() { return m_running; }
+    bool waitForFinished(int msecs = 30000);
 
+    // Fetch many files concurrently, the batch reports per item results
+    static XPNetBatch *fetchMany(const QList<XPNetBatchItem>& items,
+                                 int maxInFlight = XPNETBATCH_MAXINFLIGHT,
+                                 QObject *parent = 0,
+                                 XPNetPool::Priority priority = XPNetPool::Normal);
+
+    // Transfer class in the pool's queue, set before starting an operation
+    void setPriority(XPNetPool::Priority priority) { m_priority = priority; }
+    XPNetPool::Priority priority() { return m_priority; }
+
+    // Make the next exists() ask the hub, the file may have just changed there
+    void invalidate();
+
+    QUrl url() { return m_url; }
     QString errorString() { return m_errorString; }
     QString localFilePath() { return m_localPath; }
 
 signals:
-    void operate();
+    void finished(bool ok);
+    void abortRequested();
+
+private slots:
+    void onWorkerFinished(QString errorString);
+    void onStatReady(qint64 size, QByteArray eTag, QDateTime lastModified);
 
 private:
-    bool putToServer(int msecs = 30000);
+    void putToServer();
+    void startWorker(QObject *worker);
+    void finishLater(const QString& errorString = QString());
     bool validateUrl();
 
 private:
+    QUrl m_url;
     QString m_localPath;
     bool m_open;
+    bool m_running;
+    QObject *m_worker; // only compared, never dereferenced
+    XPNetPool::Priority m_priority;
     //
     OpenMode m_flags;
     QString m_errorString;
+    //
+    XPNetDelta m_delta; // signature of the hub's version while writing
+    QByteArray m_deltaETag;
+    //
+    qint64 m_remoteSize;
+    QByteArray m_remoteETag;
+    QDateTime m_remoteLastModified;
     //QString m_localFilePath;
 };
 
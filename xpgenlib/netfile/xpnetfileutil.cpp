@@ -0,0 +1,60 @@
+// This module implements the network file utilities of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#include <stdio.h>
+#ifdef WIN_PLATFORM
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "xpnetfileutil.h"
+
+// NOTES:
+// 1. A file written aside is synced before it is renamed over the old
+//    one, or a crash can leave the new name pointing at missing data.
+// 2. Windows can't rename over an existing file, the target is removed
+//    first and there is a moment with neither.
+//
+
+bool XPNetFileUtil::replaceFile(const QString& from, const QString& to)
+{
+#ifdef WIN_PLATFORM
+    QFile::remove(to);
+    return QFile::rename(from, to);
+#else
+    // rename() replaces the target atomically
+    return ::rename(QFile::encodeName(from).constData(), QFile::encodeName(to).constData()) == 0;
+#endif
+}
+
+bool XPNetFileUtil::syncFile(QFile& file)
+{
+    if (!file.flush())
+        return false;
+
+#ifdef WIN_PLATFORM
+    return ::_commit(file.handle()) == 0;
+#else
+    return ::fsync(file.handle()) == 0;
+#endif
+}
+
+// End of file
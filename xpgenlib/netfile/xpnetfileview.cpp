@@ -0,0 +1,97 @@
+// This module implements the cached file view of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#include <QDebug>
+
+#include "xpnetfileview.h"
+
+// NOTES:
+// 1. Parsers read the cached bytes in place instead of a heap copy.
+// 2. An empty file can't be mapped, its view is valid with no data.
+// 3. A download replacing the file renames a new one over it, the view
+//    keeps the version it mapped until it is released.
+// 4. Views are meant to be short lived, keep them on the stack.
+// 5. Only for files in the cache root, which are replaced by a rename and
+//    never truncated in place: downloads, extracts and XPNetFile writes
+//    all go through a side file. A file truncated under a mapping faults
+//    on the next read, so files the user picks are read with QFile.
+//
+
+XPNetFileView::XPNetFileView()
+    : m_map(0), m_data(""), m_size(0), m_valid(false)
+{
+}
+
+XPNetFileView::~XPNetFileView()
+{
+    unmap();
+}
+
+bool XPNetFileView::map(const QString& filePath)
+{
+    unmap();
+
+    m_file.setFileName(filePath);
+    if (!m_file.open(QFile::ReadOnly))
+    {
+        m_errorString = m_file.errorString();
+        return false;
+    }
+    if (m_file.isSequential())
+    {
+        m_errorString = "Not a regular file";
+        m_file.close();
+        return false;
+    }
+
+    m_size = m_file.size();
+    if (m_size > 0)
+    {
+        m_map = m_file.map(0, m_size);
+        if (m_map == 0)
+        {
+            m_errorString = m_file.errorString();
+            qDebug() << "XPNetFileView::map error=" << m_errorString << "file=" << filePath;
+            m_file.close();
+            m_size = 0;
+            return false;
+        }
+        m_data = reinterpret_cast<const char *>(m_map);
+    }
+
+    m_valid = true;
+
+    return true;
+}
+
+void XPNetFileView::unmap()
+{
+    if (m_map)
+        m_file.unmap(m_map);
+    m_file.close();
+
+    m_map = 0;
+    m_data = "";
+    m_size = 0;
+    m_valid = false;
+    m_errorString = "";
+}
+
+// End of file
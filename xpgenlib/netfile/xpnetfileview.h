@@ -0,0 +1,67 @@
+// This module defines the cached file view of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#ifndef XPNETFILEVIEW_H
+#define XPNETFILEVIEW_H
+
+#include "xpgenlib-mobile_global.h"
+
+#include <QFile>
+#include <QString>
+#include <QByteArray>
+
+
+/*
+ * Read only memory mapped view of a file, the mapping lives as long
+ * as the view or until unmap()
+ */
+
+class XPGENLIBMOBILESHARED_EXPORT XPNetFileView
+{
+public:
+    XPNetFileView();
+    ~XPNetFileView();
+
+    // Map a local file, a previous mapping is released first
+    bool map(const QString& filePath);
+    void unmap();
+
+    bool isValid() { return m_valid; }
+    const char *data() { return m_data; }
+    qint64 size() { return m_size; }
+
+    // The mapped bytes without a copy, only valid while the view is
+    QByteArray bytes() { return QByteArray::fromRawData(m_data, (int)m_size); }
+
+    QString errorString() { return m_errorString; }
+
+private:
+    Q_DISABLE_COPY(XPNetFileView)
+
+private:
+    QFile m_file;
+    uchar *m_map;
+    const char *m_data;
+    qint64 m_size;
+    bool m_valid;
+    QString m_errorString;
+};
+
+#endif // XPNETFILEVIEW_H
@@ -0,0 +1,307 @@
+// This module implements the network metrics of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#include <QFile>
+#include <QDebug>
+#include <QStringList>
+#include <QMutexLocker>
+
+#include "xpnetfile.h"
+#include "xpnetcachemanager.h"
+#include "xpnetmetrics.h"
+
+// NOTES:
+// 1. Workers record a transfer when it finishes, XPNetFile records the
+//    lookups the cache answers alone.
+// 2. A series is one URL class, method and outcome, e.g. "profiles GET 304".
+// 3. Latencies go in power of two buckets of milliseconds, percentiles
+//    are the upper bound of the bucket they fall in.
+// 4. Time to first byte is until the response headers, -1 is not counted.
+// 5. Recording takes one lock, the series key is a short string built
+//    before it, small next to the transfer being recorded.
+// 6. The JSON is written by hand, QJsonDocument is not in Qt4.
+// 7. The cache counters are read only if the cache manager is running,
+//    asking for metrics never starts its scan.
+// 8. Only PUTs are retried, with the whole file after a refused patch or
+//    gzip body, so retries are reported for PUT series alone.
+//
+
+/* Static class variables
+ */
+
+XPNetMetrics *XPNetMetrics::m_instance = 0;
+QMutex XPNetMetrics::m_instanceMutex;
+
+
+void XPNetMetrics::Histogram::add(qint64 msecs)
+{
+    int i = 0;
+    while (i < XPNETMETRICS_BUCKETS-1 && (1LL << i) <= msecs)
+        i++;
+    buckets[i]++;
+}
+
+qint64 XPNetMetrics::Histogram::percentile(int percent)
+{
+    quint64 total = 0;
+    for (int i=0; i<XPNETMETRICS_BUCKETS; i++)
+        total += buckets[i];
+    if (total == 0)
+        return -1;
+
+    quint64 rank = (total*percent + 99)/100;
+    quint64 seen = 0;
+    for (int i=0; i<XPNETMETRICS_BUCKETS; i++)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+            return 1LL << i;
+    }
+
+    return 1LL << (XPNETMETRICS_BUCKETS-1);
+}
+
+
+static QByteArray jsonString(const QString& text)
+{
+    QByteArray result = "\"";
+    QByteArray utf8 = text.toUtf8();
+    for (int i=0, n=utf8.size(); i<n; i++)
+    {
+        char c = utf8.at(i);
+        if (c == '"' || c == '\\')
+            result.append('\\').append(c);
+        else if ((uchar)c < 0x20)
+            result.append(QString("\\u%1").arg((int)(uchar)c, 4, 16, QChar('0')).toLatin1());
+        else
+            result.append(c);
+    }
+
+    return result + "\"";
+}
+
+static QByteArray jsonNumber(qint64 value)
+{
+    return QByteArray::number(value);
+}
+
+
+XPNetMetrics *XPNetMetrics::instance()
+{
+    QMutexLocker locker(&m_instanceMutex);
+
+    if (m_instance == 0)
+        m_instance = new XPNetMetrics;
+
+    return m_instance;
+}
+
+XPNetMetrics::XPNetMetrics()
+    : m_since(QDateTime::currentDateTime())
+{
+}
+
+QString XPNetMetrics::urlClass(const QUrl& url)
+{
+    QString path = url.path();
+    QString webPrefix = QString(XPNETFILE_WEBPREFIX);
+    if (!webPrefix.isEmpty() && path.startsWith(webPrefix+"/"))
+        path = path.mid(webPrefix.length());
+
+    QStringList segments = path.split('/', QString::SkipEmptyParts);
+    if (segments.isEmpty())
+        return "other";
+
+    // The index is asked for far more often than the rest of its class
+    if (segments.count() == 2 && segments.at(1) == "categories.index")
+        return "categories.index";
+
+    return segments.first().replace(' ', '_'); // spaces separate the series key
+}
+
+QString XPNetMetrics::outcomeName(Outcome outcome)
+{
+    switch (outcome)
+    {
+    case LocalHit:
+        return "hit";
+    case LocalMiss:
+        return "missing";
+    case NotModified:
+        return "304";
+    case Fetched:
+        return "fetched";
+    case Sent:
+        return "sent";
+    default:
+        return "failed";
+    }
+}
+
+void XPNetMetrics::record(const QString& method, const QUrl& url, int status, Outcome outcome,
+                          qint64 bytesIn, qint64 bytesOut, qint64 firstByteMs, qint64 durationMs, int retries)
+{
+    QString key = QString("%1 %2 %3").arg(urlClass(url)).arg(method).arg(outcomeName(outcome));
+
+    QMutexLocker locker(&m_mutex);
+
+    Series& series = m_series[key];
+    series.count++;
+    series.bytesIn += bytesIn;
+    series.bytesOut += bytesOut;
+    series.durationTotal += durationMs;
+    series.retries += retries;
+    if (status > 0)
+        series.statuses[status]++;
+    if (firstByteMs >= 0)
+        series.firstByte.add(firstByteMs);
+    series.duration.add(durationMs);
+}
+
+void XPNetMetrics::reset()
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_series.clear();
+    m_since = QDateTime::currentDateTime();
+}
+
+QByteArray XPNetMetrics::toJson()
+{
+    // The cache manager keeps its own counters
+    XPNetCacheManager *cache = XPNetCacheManager::existingInstance();
+    QByteArray result = "{\n    \"cache\": ";
+    if (cache)
+    {
+        result += "{\"hits\": " + jsonNumber(cache->hits());
+        result += ", \"misses\": " + jsonNumber(cache->misses());
+        result += ", \"evictions\": " + jsonNumber(cache->evictions());
+        result += ", \"bytes\": " + jsonNumber(cache->totalBytes());
+        result += ", \"quota\": " + jsonNumber(cache->quota()) + "},\n";
+    }
+    else
+    {
+        result += "null,\n";
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    result += "    \"since\": " + jsonString(m_since.toString(Qt::ISODate)) + ",\n";
+    result += "    \"series\": [";
+
+    QMap<QString, Series>::iterator i;
+    for (i = m_series.begin(); i != m_series.end(); ++i)
+    {
+        QStringList key = i.key().split(' ');
+        Series& series = i.value();
+
+        result += (i == m_series.begin()) ? "\n" : ",\n";
+        result += "        {\"class\": " + jsonString(key.value(0));
+        result += ", \"method\": " + jsonString(key.value(1));
+        result += ", \"outcome\": " + jsonString(key.value(2));
+        result += ", \"count\": " + jsonNumber(series.count);
+        result += ", \"bytesIn\": " + jsonNumber(series.bytesIn);
+        result += ", \"bytesOut\": " + jsonNumber(series.bytesOut);
+        result += ", \"durationTotalMs\": " + jsonNumber(series.durationTotal);
+        if (key.value(1) == "PUT")
+            result += ", \"retries\": " + jsonNumber(series.retries);
+
+        result += ", \"statuses\": {";
+        QMap<int, quint64>::const_iterator s;
+        for (s = series.statuses.constBegin(); s != series.statuses.constEnd(); ++s)
+        {
+            if (s != series.statuses.constBegin())
+                result += ", ";
+            result += "\"" + QByteArray::number(s.key()) + "\": " + jsonNumber(s.value());
+        }
+        result += "}";
+
+        Histogram *histograms[2] = { &series.firstByte, &series.duration };
+        const char *names[2] = { "firstByteMs", "durationMs" };
+        for (int h=0; h<2; h++)
+        {
+            result += ", \"" + QByteArray(names[h]) + "\": {";
+            result += "\"p50\": " + jsonNumber(histograms[h]->percentile(50));
+            result += ", \"p95\": " + jsonNumber(histograms[h]->percentile(95));
+            result += ", \"p99\": " + jsonNumber(histograms[h]->percentile(99));
+            result += ", \"buckets\": [";
+            for (int b=0; b<XPNETMETRICS_BUCKETS; b++)
+            {
+                if (b > 0)
+                    result += ", ";
+                result += jsonNumber(histograms[h]->buckets[b]);
+            }
+            result += "]}";
+        }
+
+        result += "}";
+    }
+    result += m_series.isEmpty() ? "]\n}\n" : "\n    ]\n}\n";
+
+    return result;
+}
+
+bool XPNetMetrics::exportJson(const QString& filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate))
+    {
+        qDebug() << "XPNetMetrics::exportJson open error=" << file.errorString();
+        return false;
+    }
+
+    QByteArray json = toJson();
+
+    return file.write(json) == json.size();
+}
+
+QString XPNetMetrics::summary()
+{
+    XPNetCacheManager *cache = XPNetCacheManager::existingInstance();
+    QString text = "Cache:\tnot in use\n\n";
+    if (cache)
+        text = QString("Cache:\thits %1\tmisses %2\tevictions %3\t%4 of %5 KB\n\n")
+                .arg(cache->hits()).arg(cache->misses()).arg(cache->evictions())
+                .arg(cache->totalBytes()/1024).arg(cache->quota()/1024);
+
+    QMutexLocker locker(&m_mutex);
+
+    text += "Series\tcount\ttotal ms\tp50/p95 ms\tfirst byte p50 ms\tKB in/out\tPUT retries\n";
+
+    QMap<QString, Series>::iterator i;
+    for (i = m_series.begin(); i != m_series.end(); ++i)
+    {
+        Series& series = i.value();
+        text += QString("%1\t%2\t%3\t%4/%5\t%6\t%7/%8\t%9\n")
+                .arg(i.key())
+                .arg(series.count)
+                .arg(series.durationTotal)
+                .arg(series.duration.percentile(50))
+                .arg(series.duration.percentile(95))
+                .arg(series.firstByte.percentile(50))
+                .arg(series.bytesIn/1024)
+                .arg(series.bytesOut/1024)
+                .arg(i.key().split(' ').value(1) == "PUT" ? QString::number(series.retries) : QString("-"));
+    }
+
+    return text;
+}
+
+// End of file
@@ -0,0 +1,138 @@
+// This module defines the network metrics of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#ifndef XPNETMETRICS_H
+#define XPNETMETRICS_H
+
+#include "xpgenlib-mobile_global.h"
+
+#include <string.h>
+
+#include <QUrl>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QByteArray>
+#include <QDateTime>
+#include <QElapsedTimer>
+
+#define XPNETMETRICS_BUCKETS 18 // power of two msecs, the last one is open ended
+
+
+/*
+ * Counters and latency histograms of every hub transfer and cache
+ * lookup, grouped by URL class, method and outcome
+ */
+
+class XPGENLIBMOBILESHARED_EXPORT XPNetMetrics
+{
+public:
+    enum Outcome
+    {
+        LocalHit,    // served from the cache without asking the hub
+        LocalMiss,   // known missing on the hub, not asked
+        NotModified, // 304
+        Fetched,     // 200 or 206
+        Sent,        // PUT accepted
+        Failed
+    };
+
+    static XPNetMetrics *instance();
+
+    // First path segment below the web prefix, e.g. "profiles"
+    static QString urlClass(const QUrl& url);
+    static QString outcomeName(Outcome outcome);
+
+    void record(const QString& method, const QUrl& url, int status, Outcome outcome,
+                qint64 bytesIn, qint64 bytesOut, qint64 firstByteMs, qint64 durationMs, int retries);
+    void reset();
+
+    QByteArray toJson(); // UTF-8
+    bool exportJson(const QString& filePath);
+    QString summary(); // one line per series for the status panel
+
+private:
+    struct Histogram
+    {
+        Histogram() { memset(buckets, 0, sizeof(buckets)); }
+
+        void add(qint64 msecs);
+        qint64 percentile(int percent); // upper bound of the bucket, -1 if empty
+
+        quint64 buckets[XPNETMETRICS_BUCKETS];
+    };
+
+    struct Series
+    {
+        Series() : count(0), bytesIn(0), bytesOut(0), durationTotal(0), retries(0) {}
+
+        quint64 count;
+        qint64 bytesIn;
+        qint64 bytesOut;
+        qint64 durationTotal; // msecs
+        quint64 retries; // PUT only
+        QMap<int, quint64> statuses;
+        Histogram firstByte;
+        Histogram duration;
+    };
+
+    XPNetMetrics();
+
+private:
+    static XPNetMetrics *m_instance; // this is a singleton
+    static QMutex m_instanceMutex;
+    //
+    QMutex m_mutex;
+    QDateTime m_since;
+    QMap<QString, Series> m_series; // "class method outcome"
+};
+
+
+/*
+ * Timing and byte counts of one transfer, kept by its worker
+ */
+
+class XPNetTransferStats
+{
+public:
+    XPNetTransferStats() : m_firstByte(-1), m_bytesIn(0), m_bytesOut(0), m_retries(0) {}
+
+    void start() { m_clock.start(); }
+    void markFirstByte() { if (m_firstByte < 0 && m_clock.isValid()) m_firstByte = m_clock.elapsed(); }
+    void addBytesIn(qint64 bytes) { m_bytesIn += bytes; }
+    void addBytesOut(qint64 bytes) { m_bytesOut += bytes; }
+    void addRetry() { m_retries++; }
+
+    void record(const QString& method, const QUrl& url, int status, XPNetMetrics::Outcome outcome)
+    {
+        qint64 duration = m_clock.isValid() ? m_clock.elapsed() : 0;
+        XPNetMetrics::instance()->record(method, url, status, outcome, m_bytesIn, m_bytesOut,
+                                         m_firstByte, duration, m_retries);
+    }
+
+private:
+    QElapsedTimer m_clock;
+    qint64 m_firstByte; // msecs, -1 until the reply starts
+    qint64 m_bytesIn;
+    qint64 m_bytesOut;
+    int m_retries;
+};
+
+#endif // XPNETMETRICS_H
@@ -0,0 +1,640 @@
+// This module implements the cache pack store of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#include <string.h>
+
+#include <QDir>
+#include <QDebug>
+#include <QFileInfo>
+#include <QSettings>
+#include <QtEndian>
+#include <QDateTime>
+#include <QMutexLocker>
+#include <QCryptographicHash>
+
+#include "xpnetetagindex.h"
+#include "xpnetpackstore.h"
+#include "xpnetfileutil.h"
+
+// NOTES:
+// 1. One pack file in the cache root holds a single copy of every
+//    distinct content, addressed by its MD5, plus the path index.
+// 2. The pack is a log of records, little endian:
+//      'B' [hash:16][len:4][checksum:2] content
+//      'P' [keyLen:4][tagLen:4][size:8][modified:8][hash:16][key][tag][checksum:2]
+//      'R' [keyLen:4][key][checksum:2]
+//    the blob checksum covers its header only, the content is checked
+//    against its MD5 when it is read.
+// 3. At startup the pack is memory mapped and replayed, only the record
+//    headers are touched and a torn tail is cut off.
+// 4. A path record keeps the size and time of the loose file it was taken
+//    from and its ETag, so a file changed since is never mistaken for it.
+// 5. Blobs no path refers to, path records a later one supersedes and
+//    remove records all count as dead bytes, the pack is rewritten when
+//    they make up most of it.
+// 6. The loose files stay the working set, packed ones can be dropped by
+//    the cache manager and written back by extract() without the hub.
+//
+
+#define XPNETPACKSTORE_BLOB 'B'
+#define XPNETPACKSTORE_PATH 'P'
+#define XPNETPACKSTORE_REMOVE 'R'
+
+#define XPNETPACKSTORE_HASH_SIZE 16
+#define XPNETPACKSTORE_CHECKSUM_SIZE 2
+#define XPNETPACKSTORE_BLOB_HEADER (1+XPNETPACKSTORE_HASH_SIZE+4+XPNETPACKSTORE_CHECKSUM_SIZE)
+#define XPNETPACKSTORE_PATH_HEADER (1+4+4+8+8+XPNETPACKSTORE_HASH_SIZE)
+#define XPNETPACKSTORE_REMOVE_HEADER (1+4)
+#define XPNETPACKSTORE_SLACK (1024*1024)
+
+#define XPNETPACKSTORE_MAGIC_SIZE ((qint64)(sizeof(XPNETPACKSTORE_MAGIC)-1))
+
+
+/* Static class variables
+ */
+
+XPNetPackStore *XPNetPackStore::m_instance = 0;
+QMutex XPNetPackStore::m_instanceMutex;
+
+
+static void appendChecksum(QByteArray& record)
+{
+    uchar checksum[XPNETPACKSTORE_CHECKSUM_SIZE];
+    qToLittleEndian<quint16>(qChecksum(record.constData(), record.size()), checksum);
+    record.append(reinterpret_cast<const char *>(checksum), XPNETPACKSTORE_CHECKSUM_SIZE);
+}
+
+static bool checksumOk(const uchar *record, qint64 size)
+{
+    quint16 checksum = qFromLittleEndian<quint16>(record + size);
+    return qChecksum(reinterpret_cast<const char *>(record), size) == checksum;
+}
+
+static qint64 pathRecordSize(const QString& key, const QByteArray& eTag)
+{
+    return XPNETPACKSTORE_PATH_HEADER + key.toUtf8().size() + eTag.size() + XPNETPACKSTORE_CHECKSUM_SIZE;
+}
+
+static qint64 removeRecordSize(const QString& key)
+{
+    return XPNETPACKSTORE_REMOVE_HEADER + key.toUtf8().size() + XPNETPACKSTORE_CHECKSUM_SIZE;
+}
+
+
+XPNetPackStore *XPNetPackStore::instance()
+{
+    QMutexLocker locker(&m_instanceMutex);
+
+    if (m_instance == 0)
+        m_instance = new XPNetPackStore(XPNetEtagIndex::instance()->cacheRoot());
+
+    return m_instance;
+}
+
+XPNetPackStore::XPNetPackStore(const QString& cacheRoot)
+    : m_cacheRoot(cacheRoot), m_map(0), m_mapSize(0), m_deadBytes(0)
+{
+    QSettings settings;
+    m_enabled = settings.value(XPNETPACKSTORE_ENABLE_KEY, false).toBool();
+
+    if (m_enabled)
+        load();
+}
+
+XPNetPackStore::~XPNetPackStore()
+{
+    if (m_map)
+        m_file.unmap(m_map);
+    m_file.close();
+}
+
+bool XPNetPackStore::store(const QString& localPath)
+{
+    if (!m_enabled)
+        return false;
+
+    QFile file(localPath);
+    if (!file.open(QFile::ReadOnly) || file.size() > XPNETPACKSTORE_MAXBLOB)
+        return false;
+
+    QByteArray data = file.readAll();
+    QFileInfo fi(localPath);
+
+    Path path;
+    path.hash = QCryptographicHash::hash(data, QCryptographicHash::Md5);
+    path.eTag = XPNetEtagIndex::instance()->value(localPath);
+    path.size = data.size();
+    path.lastModified = fi.lastModified().toMSecsSinceEpoch();
+    QString key = XPNetEtagIndex::instance()->key(localPath);
+
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_file.isOpen())
+        return false;
+
+    // Nothing to do if the same file is already packed
+    QHash<QString, Path>::const_iterator i = m_paths.constFind(key);
+    if (i != m_paths.constEnd() && i.value().hash == path.hash && i.value().eTag == path.eTag
+        && i.value().size == path.size && i.value().lastModified == path.lastModified)
+        return true;
+
+    // Identical content is stored once
+    if (!m_blobs.contains(path.hash) && appendBlob(path.hash, data) < 0)
+        return false;
+
+    appendPath(key, path);
+    setPath(key, path);
+    compactIfDead();
+
+    return true;
+}
+
+bool XPNetPackStore::isPacked(const QString& localPath)
+{
+    if (!m_enabled)
+        return false;
+
+    QFileInfo fi(localPath);
+    QByteArray eTag = XPNetEtagIndex::instance()->value(localPath);
+    QString key = XPNetEtagIndex::instance()->key(localPath);
+
+    QMutexLocker locker(&m_mutex);
+
+    QHash<QString, Path>::const_iterator i = m_paths.constFind(key);
+    if (i == m_paths.constEnd())
+        return false;
+
+    return fi.exists() && fi.size() == i.value().size
+        && fi.lastModified().toMSecsSinceEpoch() == i.value().lastModified
+        && !eTag.isEmpty() && eTag == i.value().eTag;
+}
+
+bool XPNetPackStore::hasVersion(const QString& localPath, const QByteArray& eTag, qint64 size)
+{
+    if (!m_enabled || eTag.isEmpty())
+        return false;
+
+    QString key = XPNetEtagIndex::instance()->key(localPath);
+
+    QMutexLocker locker(&m_mutex);
+
+    QHash<QString, Path>::const_iterator i = m_paths.constFind(key);
+
+    return i != m_paths.constEnd() && i.value().eTag == eTag && i.value().size == size;
+}
+
+bool XPNetPackStore::extract(const QString& localPath)
+{
+    QByteArray data = read(localPath);
+    if (data.isNull())
+        return false;
+
+    QFileInfo fi(localPath);
+    QDir dir;
+    dir.mkpath(fi.path());
+
+    // Written aside and renamed so a reader never sees half a file
+    QFile file(localPath + ".new");
+    bool ok = file.open(QFile::WriteOnly | QFile::Truncate) && file.write(data) == data.size() && file.flush();
+    file.close();
+    if (!ok || !XPNetFileUtil::replaceFile(file.fileName(), localPath))
+    {
+        qDebug() << "XPNetPackStore::extract write error=" << file.errorString();
+        QFile::remove(file.fileName());
+        return false;
+    }
+
+    // The restored loose file is the packed one
+    fi.refresh();
+    QString key = XPNetEtagIndex::instance()->key(localPath);
+
+    QMutexLocker locker(&m_mutex);
+
+    QHash<QString, Path>::iterator i = m_paths.find(key);
+    if (i != m_paths.end())
+    {
+        Path path = i.value();
+        path.lastModified = fi.lastModified().toMSecsSinceEpoch();
+        appendPath(key, path);
+        setPath(key, path);
+        compactIfDead();
+    }
+
+    locker.unlock();
+
+    // It is the hub's version again
+    QByteArray eTag = XPNetEtagIndex::instance()->value(localPath);
+    if (!eTag.isEmpty())
+        XPNetEtagIndex::instance()->setValue(localPath, eTag);
+
+    qDebug() << "XPNetPackStore::extract file=" << key << "size=" << data.size();
+
+    return true;
+}
+
+QByteArray XPNetPackStore::read(const QString& localPath)
+{
+    if (!m_enabled)
+        return QByteArray();
+
+    QByteArray eTag = XPNetEtagIndex::instance()->value(localPath);
+    QString key = XPNetEtagIndex::instance()->key(localPath);
+
+    QMutexLocker locker(&m_mutex);
+
+    // Only the version the ETag index knows about will do
+    QHash<QString, Path>::const_iterator i = m_paths.constFind(key);
+    if (i == m_paths.constEnd() || eTag.isEmpty() || i.value().eTag != eTag)
+        return QByteArray();
+
+    QHash<QByteArray, Blob>::const_iterator b = m_blobs.constFind(i.value().hash);
+    if (b == m_blobs.constEnd())
+        return QByteArray();
+
+    const uchar *p = blobData(b.value());
+    if (p == 0)
+        return QByteArray();
+
+    QByteArray data(reinterpret_cast<const char *>(p), b.value().size);
+    if (QCryptographicHash::hash(data, QCryptographicHash::Md5) != b.key())
+    {
+        qDebug() << "XPNetPackStore::read damaged blob for" << key;
+        return QByteArray();
+    }
+
+    return data;
+}
+
+void XPNetPackStore::remove(const QString& localPath)
+{
+    if (!m_enabled)
+        return;
+
+    QString key = XPNetEtagIndex::instance()->key(localPath);
+
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_paths.contains(key))
+        return;
+
+    appendRemove(key);
+    unsetPath(key);
+    compactIfDead();
+}
+
+void XPNetPackStore::compact()
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_file.isOpen())
+        compactIfDead();
+}
+
+int XPNetPackStore::blobCount()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_blobs.count();
+}
+
+int XPNetPackStore::pathCount()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_paths.count();
+}
+
+qint64 XPNetPackStore::packSize()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_file.isOpen() ? m_file.size() : 0;
+}
+
+void XPNetPackStore::load()
+{
+    QDir dir;
+    dir.mkpath(m_cacheRoot);
+
+    m_file.setFileName(QString("%1/%2").arg(m_cacheRoot).arg(XPNETPACKSTORE_FILENAME));
+    if (!m_file.open(QFile::ReadWrite))
+    {
+        qDebug() << "XPNetPackStore::load open error=" << m_file.errorString();
+        return;
+    }
+
+    // Replay the record headers straight out of the mapped file
+    //
+    qint64 fileSize = m_file.size();
+    qint64 validSize = 0;
+
+    uchar *data = (fileSize >= XPNETPACKSTORE_MAGIC_SIZE) ? m_file.map(0, fileSize) : 0;
+    if (data && memcmp(data, XPNETPACKSTORE_MAGIC, XPNETPACKSTORE_MAGIC_SIZE) == 0)
+    {
+        const uchar *p = data + XPNETPACKSTORE_MAGIC_SIZE;
+        const uchar *end = data + fileSize;
+        validSize = XPNETPACKSTORE_MAGIC_SIZE;
+
+        while (end - p > 0)
+        {
+            qint64 size;
+
+            if (*p == XPNETPACKSTORE_BLOB)
+            {
+                if (end - p < XPNETPACKSTORE_BLOB_HEADER
+                    || !checksumOk(p, XPNETPACKSTORE_BLOB_HEADER - XPNETPACKSTORE_CHECKSUM_SIZE))
+                    break;
+                quint32 len = qFromLittleEndian<quint32>(p + 1 + XPNETPACKSTORE_HASH_SIZE);
+                size = (qint64)XPNETPACKSTORE_BLOB_HEADER + len;
+                if (end - p < size)
+                    break;
+
+                QByteArray hash(reinterpret_cast<const char *>(p + 1), XPNETPACKSTORE_HASH_SIZE);
+                if (!m_blobs.contains(hash))
+                {
+                    Blob blob;
+                    blob.offset = (p - data) + XPNETPACKSTORE_BLOB_HEADER;
+                    blob.size = len;
+                    blob.refs = 0;
+                    m_blobs.insert(hash, blob);
+                    m_deadBytes += len;
+                }
+            }
+            else if (*p == XPNETPACKSTORE_PATH)
+            {
+                if (end - p < XPNETPACKSTORE_PATH_HEADER)
+                    break;
+                quint32 keyLen = qFromLittleEndian<quint32>(p + 1);
+                quint32 tagLen = qFromLittleEndian<quint32>(p + 5);
+                size = (qint64)XPNETPACKSTORE_PATH_HEADER + keyLen + tagLen + XPNETPACKSTORE_CHECKSUM_SIZE;
+                if (end - p < size || !checksumOk(p, size - XPNETPACKSTORE_CHECKSUM_SIZE))
+                    break;
+
+                Path path;
+                path.size = qFromLittleEndian<qint64>(p + 9);
+                path.lastModified = qFromLittleEndian<qint64>(p + 17);
+                path.hash = QByteArray(reinterpret_cast<const char *>(p + 25), XPNETPACKSTORE_HASH_SIZE);
+                const char *keyData = reinterpret_cast<const char *>(p + XPNETPACKSTORE_PATH_HEADER);
+                path.eTag = QByteArray(keyData + keyLen, tagLen);
+                if (!m_blobs.contains(path.hash))
+                    break; // blobs always come first
+                setPath(QString::fromUtf8(keyData, keyLen), path);
+            }
+            else if (*p == XPNETPACKSTORE_REMOVE)
+            {
+                if (end - p < XPNETPACKSTORE_REMOVE_HEADER)
+                    break;
+                quint32 keyLen = qFromLittleEndian<quint32>(p + 1);
+                size = (qint64)XPNETPACKSTORE_REMOVE_HEADER + keyLen + XPNETPACKSTORE_CHECKSUM_SIZE;
+                if (end - p < size || !checksumOk(p, size - XPNETPACKSTORE_CHECKSUM_SIZE))
+                    break;
+
+                unsetPath(QString::fromUtf8(reinterpret_cast<const char *>(p + XPNETPACKSTORE_REMOVE_HEADER), keyLen));
+            }
+            else
+            {
+                break;
+            }
+
+            p += size;
+            validSize += size;
+        }
+    }
+    if (data)
+        m_file.unmap(data);
+
+    // Start a new pack or cut off a torn tail
+    if (validSize == 0)
+    {
+        m_file.resize(0);
+        m_file.write(XPNETPACKSTORE_MAGIC, XPNETPACKSTORE_MAGIC_SIZE);
+        m_file.flush();
+        validSize = XPNETPACKSTORE_MAGIC_SIZE;
+    }
+    else if (validSize < fileSize)
+    {
+        qDebug() << "XPNetPackStore::load dropped" << fileSize-validSize << "bytes of torn records";
+        m_file.resize(validSize);
+    }
+    m_file.seek(validSize);
+
+    qDebug() << "XPNetPackStore::load blobs=" << m_blobs.count() << "paths=" << m_paths.count()
+             << "size=" << validSize << "dead=" << m_deadBytes;
+
+    compactIfDead();
+}
+
+qint64 XPNetPackStore::appendBlob(const QByteArray& hash, const QByteArray& data)
+{
+    QByteArray record(1, XPNETPACKSTORE_BLOB);
+    record.append(hash);
+    uchar len[4];
+    qToLittleEndian<quint32>(data.size(), len);
+    record.append(reinterpret_cast<const char *>(len), 4);
+    appendChecksum(record);
+
+    qint64 offset = m_file.pos() + record.size();
+    record.append(data);
+
+    // A single write so a crash leaves at most one torn record
+    if (m_file.write(record) != record.size() || !m_file.flush())
+    {
+        qDebug() << "XPNetPackStore::appendBlob write error=" << m_file.errorString();
+        return -1;
+    }
+
+    Blob blob;
+    blob.offset = offset;
+    blob.size = data.size();
+    blob.refs = 0;
+    m_blobs.insert(hash, blob);
+    m_deadBytes += blob.size; // until a path refers to it
+
+    return offset;
+}
+
+void XPNetPackStore::appendPath(const QString& key, const Path& path)
+{
+    QByteArray keyData = key.toUtf8();
+    QByteArray record(XPNETPACKSTORE_PATH_HEADER - XPNETPACKSTORE_HASH_SIZE, 0);
+    uchar *header = reinterpret_cast<uchar *>(record.data());
+
+    header[0] = XPNETPACKSTORE_PATH;
+    qToLittleEndian<quint32>(keyData.size(), header+1);
+    qToLittleEndian<quint32>(path.eTag.size(), header+5);
+    qToLittleEndian<qint64>(path.size, header+9);
+    qToLittleEndian<qint64>(path.lastModified, header+17);
+    record.append(path.hash);
+    record.append(keyData);
+    record.append(path.eTag);
+    appendChecksum(record);
+
+    m_file.write(record);
+    m_file.flush();
+}
+
+void XPNetPackStore::appendRemove(const QString& key)
+{
+    QByteArray keyData = key.toUtf8();
+    QByteArray record(XPNETPACKSTORE_REMOVE_HEADER, 0);
+    uchar *header = reinterpret_cast<uchar *>(record.data());
+
+    header[0] = XPNETPACKSTORE_REMOVE;
+    qToLittleEndian<quint32>(keyData.size(), header+1);
+    record.append(keyData);
+    appendChecksum(record);
+
+    m_file.write(record);
+    m_file.flush();
+}
+
+void XPNetPackStore::setPath(const QString& key, const Path& path)
+{
+    // Move the reference from the old content to the new one, the old
+    // path record is superseded
+    QHash<QString, Path>::iterator i = m_paths.find(key);
+    if (i != m_paths.end())
+    {
+        QHash<QByteArray, Blob>::iterator b = m_blobs.find(i.value().hash);
+        if (b != m_blobs.end() && --b.value().refs == 0)
+            m_deadBytes += b.value().size;
+        m_deadBytes += pathRecordSize(key, i.value().eTag);
+    }
+
+    QHash<QByteArray, Blob>::iterator b = m_blobs.find(path.hash);
+    if (b.value().refs++ == 0)
+        m_deadBytes -= b.value().size;
+
+    m_paths.insert(key, path);
+}
+
+void XPNetPackStore::unsetPath(const QString& key)
+{
+    // Both the remove record and the path record it cancels are dead
+    m_deadBytes += removeRecordSize(key);
+
+    QHash<QString, Path>::iterator i = m_paths.find(key);
+    if (i == m_paths.end())
+        return;
+
+    QHash<QByteArray, Blob>::iterator b = m_blobs.find(i.value().hash);
+    if (b != m_blobs.end() && --b.value().refs == 0)
+        m_deadBytes += b.value().size;
+    m_deadBytes += pathRecordSize(key, i.value().eTag);
+    m_paths.erase(i);
+}
+
+void XPNetPackStore::compactIfDead()
+{
+    if (m_deadBytes > XPNETPACKSTORE_SLACK && m_deadBytes > m_file.size()/2)
+        compactLocked();
+}
+
+const uchar *XPNetPackStore::blobData(const Blob& blob)
+{
+    // Map again once the pack has grown past the mapped part
+    if (m_map == 0 || blob.offset + blob.size > m_mapSize)
+    {
+        if (m_map)
+            m_file.unmap(m_map);
+        m_mapSize = m_file.size();
+        m_map = m_file.map(0, m_mapSize);
+        if (m_map == 0)
+        {
+            qDebug() << "XPNetPackStore::blobData map error=" << m_file.errorString();
+            return 0;
+        }
+    }
+
+    return m_map + blob.offset;
+}
+
+void XPNetPackStore::compactLocked()
+{
+    // Copy the live blobs and paths to a new pack and swap it in atomically
+    QFile newFile(m_file.fileName() + ".new");
+    if (!newFile.open(QFile::WriteOnly | QFile::Truncate))
+    {
+        qDebug() << "XPNetPackStore::compact open error=" << newFile.errorString();
+        return;
+    }
+
+    qint64 oldSize = m_file.size();
+    QHash<QByteArray, Blob> blobs;
+    bool ok = newFile.write(XPNETPACKSTORE_MAGIC, XPNETPACKSTORE_MAGIC_SIZE) == XPNETPACKSTORE_MAGIC_SIZE;
+
+    QHash<QByteArray, Blob>::const_iterator b;
+    for (b = m_blobs.constBegin(); ok && b != m_blobs.constEnd(); ++b)
+    {
+        if (b.value().refs == 0)
+            continue;
+        const uchar *p = blobData(b.value());
+        if (p == 0)
+        {
+            ok = false;
+            break;
+        }
+
+        QByteArray record(1, XPNETPACKSTORE_BLOB);
+        record.append(b.key());
+        uchar len[4];
+        qToLittleEndian<quint32>(b.value().size, len);
+        record.append(reinterpret_cast<const char *>(len), 4);
+        appendChecksum(record);
+
+        Blob blob = b.value();
+        blob.offset = newFile.pos() + record.size();
+        blobs.insert(b.key(), blob);
+
+        ok = newFile.write(record) == record.size()
+            && newFile.write(reinterpret_cast<const char *>(p), b.value().size) == b.value().size;
+    }
+
+    ok = ok && XPNetFileUtil::syncFile(newFile);
+    newFile.close();
+
+    if (m_map)
+        m_file.unmap(m_map);
+    m_map = 0;
+    m_mapSize = 0;
+    m_file.close();
+
+    if (!ok || !XPNetFileUtil::replaceFile(newFile.fileName(), m_file.fileName()))
+    {
+        // The old pack is still in place and so are the offsets
+        qDebug() << "XPNetPackStore::compact replace error=" << newFile.errorString();
+        QFile::remove(newFile.fileName());
+        if (m_file.open(QFile::ReadWrite))
+            m_file.seek(m_file.size());
+        return;
+    }
+
+    // The path records follow the blobs in the new pack
+    m_blobs = blobs;
+    m_deadBytes = 0;
+    if (m_file.open(QFile::ReadWrite))
+    {
+        m_file.seek(m_file.size());
+        QHash<QString, Path>::const_iterator i;
+        for (i = m_paths.constBegin(); i != m_paths.constEnd(); ++i)
+            appendPath(i.key(), i.value());
+    }
+
+    qDebug() << "XPNetPackStore::compact size=" << oldSize << "->" << m_file.size();
+}
+
+// End of file
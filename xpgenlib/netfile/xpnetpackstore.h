@@ -0,0 +1,109 @@
+// This module defines the cache pack store of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#ifndef XPNETPACKSTORE_H
+#define XPNETPACKSTORE_H
+
+#include <QHash>
+#include <QList>
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <QByteArray>
+
+#define XPNETPACKSTORE_FILENAME ".xppack"
+#define XPNETPACKSTORE_MAGIC "XPPACK01"
+#define XPNETPACKSTORE_ENABLE_KEY "net-cache/pack"
+#define XPNETPACKSTORE_MAXBLOB (1024*1024) // larger files stay loose only
+
+
+/*
+ * Content addressed store for the cached files: every distinct content
+ * is kept once in an append only, memory mapped pack, with a path index
+ */
+
+class XPNetPackStore
+{
+public:
+    static XPNetPackStore *instance();
+
+    // Off unless the "net-cache/pack" setting is true
+    bool isEnabled() { return m_enabled; }
+
+    // Keys are local file paths, stored relative to the cache root
+    bool store(const QString& localPath);
+    bool isPacked(const QString& localPath);
+    bool hasVersion(const QString& localPath, const QByteArray& eTag, qint64 size); // loose copy or not
+    bool extract(const QString& localPath);
+    QByteArray read(const QString& localPath);
+    void remove(const QString& localPath);
+
+    // Drop the blobs no path refers to any more
+    void compact();
+
+    int blobCount();
+    int pathCount();
+    qint64 packSize();
+
+private:
+    struct Blob
+    {
+        qint64 offset; // of the content
+        quint32 size;
+        int refs;
+    };
+
+    struct Path
+    {
+        QByteArray hash;
+        QByteArray eTag; // ETag of the content when it was packed
+        qint64 size;
+        qint64 lastModified; // of the loose file, msecs since the epoch
+    };
+
+    explicit XPNetPackStore(const QString& cacheRoot);
+    ~XPNetPackStore();
+    //
+    void load();
+    qint64 appendBlob(const QByteArray& hash, const QByteArray& data);
+    void appendPath(const QString& key, const Path& path);
+    void appendRemove(const QString& key);
+    void setPath(const QString& key, const Path& path);
+    void unsetPath(const QString& key);
+    const uchar *blobData(const Blob& blob);
+    void compactLocked();
+    void compactIfDead();
+
+private:
+    static XPNetPackStore *m_instance; // this is a singleton
+    static QMutex m_instanceMutex;
+    //
+    QMutex m_mutex;
+    bool m_enabled;
+    QString m_cacheRoot;
+    QFile m_file; // append only log of blobs and paths
+    uchar *m_map;
+    qint64 m_mapSize;
+    qint64 m_deadBytes;
+    QHash<QByteArray, Blob> m_blobs; // MD5 of the content
+    QHash<QString, Path> m_paths;
+};
+
+#endif // XPNETPACKSTORE_H
@@ -0,0 +1,315 @@
+// This module implements the network thread pool of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#include <QDebug>
+#include <QSettings>
+#include <QMutexLocker>
+#include <QCoreApplication>
+
+#include "xpnetdelta.h"
+#include "xpnetpool.h"
+
+// NOTES:
+// 1. A small fixed set of long lived threads runs every network transfer.
+// 2. Workers are moved onto a pool thread and deleted there when done.
+// 3. The pool is owned by the application object and stops with it.
+// 4. Each hub is bound to one thread and one QNetworkAccessManager so
+//    its connections stay open (HTTP/1.1 keep-alive) between transfers.
+// 5. A PUT body is only gzip encoded for a hub that lists gzip in an
+//    Accept-Encoding response header (RFC 7694), a plain WebDAV handler
+//    would store the compressed bytes as the file. Delta patches likewise
+//    need the patch type in an Accept-Patch header (RFC 5789). A later
+//    refusal wins.
+// 6. At most XPNETPOOL_MAXACTIVE transfers run per hub, the rest wait in
+//    priority order. Interactive work is never queued and background work
+//    only starts when nothing else waits and no interactive transfer runs.
+// 7. A worker is done when it is destroyed, its slot then goes to the next.
+//    The queues are shared with the pool threads and guarded by m_mutex.
+// 8. A worker aborted while queued is taken out of the queue and never
+//    runs, one aborted after it got its slot gives the slot back unused.
+// 9. Background downloads read through a token bucket refilled at the
+//    configured rate and holding at most one second's worth.
+// 10. A segmented GET holds one slot while its range requests use up to
+//     XPNETFILE_SEGMENTS connections, they carry the worker's request
+//     priority. Background downloads are never segmented, so the extra
+//     connections can't get around the bucket or the queue order.
+//
+
+#define XPNETPOOL_PRIORITY "xpnetpool-priority"
+
+/* Static class variables
+ */
+
+XPNetPool *XPNetPool::m_instance = 0;
+QMutex XPNetPool::m_instanceMutex;
+
+
+XPNetPool *XPNetPool::instance()
+{
+    QMutexLocker locker(&m_instanceMutex);
+
+    if (m_instance == 0)
+        m_instance = new XPNetPool(QCoreApplication::instance());
+
+    return m_instance;
+}
+
+XPNetPool::XPNetPool(QObject *parent)
+    : QObject(parent), m_tokens(0), m_bucketTime(0)
+{
+    QSettings settings;
+    m_backgroundRate = settings.value(XPNETPOOL_BACKGROUND_RATE_KEY, XPNETPOOL_BACKGROUND_RATE).toLongLong()*1024;
+    m_tokens = m_backgroundRate;
+    m_bucketClock.start();
+
+    for (int i=0; i<XPNETPOOL_THREADS; i++)
+    {
+        QThread *thread = new QThread(this);
+        thread->setObjectName(QString("XPNetPool-%1").arg(i));
+        thread->start();
+        m_threads.append(thread);
+    }
+}
+
+XPNetPool::~XPNetPool()
+{
+    qDebug() << "~XPNetPool";
+
+    // Stop the threads and wait until they exit
+    for (int i=0, n=m_threads.count(); i<n; i++)
+    {
+        m_threads.at(i)->quit();
+        m_threads.at(i)->wait();
+    }
+
+    QMutexLocker locker(&m_instanceMutex);
+    m_instance = 0;
+}
+
+void XPNetPool::start(QObject *worker, const QUrl& url, Priority priority)
+{
+    // The same hub always lands on the same thread
+    QThread *thread = m_threads.at(qHash(hubKey(url)) % m_threads.count());
+
+    // Called on the pool thread as the worker goes, before its address
+    // can be reused, so the pointer is a safe key
+    worker->setProperty(XPNETPOOL_PRIORITY, (int)priority);
+    connect(worker, SIGNAL(destroyed(QObject*)), this, SLOT(onWorkerDestroyed(QObject*)), Qt::DirectConnection);
+    worker->moveToThread(thread);
+
+    QMutexLocker locker(&m_mutex);
+
+    QString hub = hubKey(url);
+    if (priority == Interactive)
+        run(worker, hub, priority);
+    else
+    {
+        m_hubs[hub].queued[priority].append(worker);
+        dispatch(hub);
+    }
+}
+
+bool XPNetPool::cancel(QObject *worker)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QHash<QString, Hub>::iterator i;
+    for (i = m_hubs.begin(); i != m_hubs.end(); ++i)
+    {
+        if (i.value().queued[Normal].removeOne(worker) || i.value().queued[Background].removeOne(worker))
+            return true;
+    }
+
+    return false;
+}
+
+XPNetPool::Priority XPNetPool::priority(QObject *worker)
+{
+    QVariant value = worker->property(XPNETPOOL_PRIORITY);
+
+    return value.isValid() ? (Priority)value.toInt() : Normal;
+}
+
+QNetworkRequest::Priority XPNetPool::requestPriority(QObject *worker)
+{
+    // The manager's own queue for a free connection honours it too
+    switch (priority(worker))
+    {
+    case Interactive:
+        return QNetworkRequest::HighPriority;
+    case Background:
+        return QNetworkRequest::LowPriority;
+    default:
+        return QNetworkRequest::NormalPriority;
+    }
+}
+
+bool XPNetPool::isThrottled(QObject *worker)
+{
+    return priority(worker) == Background && m_backgroundRate > 0;
+}
+
+qint64 XPNetPool::takeBackgroundBytes(qint64 wanted)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_backgroundRate <= 0)
+        return wanted;
+
+    // Refill for the time passed, the bucket holds one second's worth
+    qint64 now = m_bucketClock.elapsed();
+    qint64 refill = (now - m_bucketTime)*m_backgroundRate/1000;
+    if (refill > 0)
+    {
+        m_tokens = qMin(m_tokens + refill, m_backgroundRate);
+        m_bucketTime = now;
+    }
+
+    qint64 taken = qMin(wanted, m_tokens);
+    m_tokens -= taken;
+
+    return taken;
+}
+
+void XPNetPool::onWorkerDestroyed(QObject *worker)
+{
+    QMutexLocker locker(&m_mutex);
+
+    // The properties went with the object, find the slot it held
+    if (!m_running.contains(worker))
+        return;
+    QPair<QString, int> held = m_running.take(worker);
+
+    m_hubs[held.first].active[held.second]--;
+    dispatch(held.first);
+}
+
+void XPNetPool::dispatch(const QString& hub)
+{
+    Hub& h = m_hubs[hub];
+
+    forever
+    {
+        int active = h.active[Interactive] + h.active[Normal] + h.active[Background];
+        if (active >= XPNETPOOL_MAXACTIVE)
+            break;
+
+        if (!h.queued[Normal].isEmpty())
+            run(h.queued[Normal].takeFirst(), hub, Normal);
+        else if (!h.queued[Background].isEmpty()
+                 && h.active[Interactive] == 0
+                 && h.active[Background] < XPNETPOOL_BACKGROUND_SLOTS)
+            run(h.queued[Background].takeFirst(), hub, Background);
+        else
+            break;
+    }
+}
+
+void XPNetPool::run(QObject *worker, const QString& hub, Priority priority)
+{
+    m_hubs[hub].active[priority]++;
+    m_running.insert(worker, qMakePair(hub, (int)priority));
+
+    QMetaObject::invokeMethod(worker, "doWork", Qt::QueuedConnection);
+}
+
+QNetworkAccessManager *XPNetPool::networkManager(const QUrl& url)
+{
+    // Managers are parented to a per thread object which is
+    // deleted by QThreadStorage when the pool thread exits
+    if (!m_managers.hasLocalData())
+        m_managers.setLocalData(new QObject);
+    QObject *managers = m_managers.localData();
+
+    QString hub = hubKey(url);
+    QNetworkAccessManager *manager = managers->findChild<QNetworkAccessManager *>(hub);
+    if (manager == 0)
+    {
+        qDebug() << "XPNetPool::networkManager new manager for hub=" << hub;
+        manager = new QNetworkAccessManager(managers);
+        manager->setObjectName(hub);
+    }
+
+    return manager;
+}
+
+void XPNetPool::noteCapabilities(const QUrl& url, QNetworkReply *reply)
+{
+    bool gzip = reply->rawHeader("Accept-Encoding").toLower().contains("gzip");
+    bool delta = reply->rawHeader("Accept-Patch").toLower().contains(XPNETDELTA_CONTENTTYPE);
+    if (!gzip && !delta)
+        return;
+
+    QMutexLocker locker(&m_mutex);
+
+    // Only untried hubs, a refused PUT has the last word
+    QString hub = hubKey(url);
+    if (gzip && !m_acceptsGzip.contains(hub))
+    {
+        qDebug() << "XPNetPool::noteCapabilities hub=" << hub << "accepts gzip";
+        m_acceptsGzip.insert(hub, true);
+    }
+    if (delta && !m_acceptsDelta.contains(hub))
+    {
+        qDebug() << "XPNetPool::noteCapabilities hub=" << hub << "accepts delta";
+        m_acceptsDelta.insert(hub, true);
+    }
+}
+
+bool XPNetPool::acceptsGzip(const QUrl& url)
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_acceptsGzip.value(hubKey(url), false);
+}
+
+void XPNetPool::setAcceptsGzip(const QUrl& url, bool accepts)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QString hub = hubKey(url);
+    if (m_acceptsGzip.value(hub, false) != accepts)
+        qDebug() << "XPNetPool::setAcceptsGzip hub=" << hub << "accepts=" << accepts;
+    m_acceptsGzip.insert(hub, accepts);
+}
+
+bool XPNetPool::acceptsDelta(const QUrl& url)
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_acceptsDelta.value(hubKey(url), false);
+}
+
+void XPNetPool::setAcceptsDelta(const QUrl& url, bool accepts)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QString hub = hubKey(url);
+    if (m_acceptsDelta.value(hub, false) != accepts)
+        qDebug() << "XPNetPool::setAcceptsDelta hub=" << hub << "accepts=" << accepts;
+    m_acceptsDelta.insert(hub, accepts);
+}
+
+QString XPNetPool::hubKey(const QUrl& url)
+{
+    return QString("%1:%2").arg(url.host()).arg(url.port(80));
+}
+
+// End of file
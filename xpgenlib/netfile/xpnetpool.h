@@ -0,0 +1,130 @@
+// This module defines the network thread pool of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#ifndef XPNETPOOL_H
+#define XPNETPOOL_H
+
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QUrl>
+#include <QMutex>
+#include <QObject>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QThreadStorage>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QNetworkAccessManager>
+
+#define XPNETPOOL_THREADS 2
+#define XPNETPOOL_MAXACTIVE 6 // transfers per hub, as many as the manager has connections
+#define XPNETPOOL_BACKGROUND_SLOTS 2 // of those background work may take
+#define XPNETPOOL_BACKGROUND_RATE_KEY "net-qos/backgroundKBps"
+#define XPNETPOOL_BACKGROUND_RATE 1024 // KB/s, 0 for no cap
+#define XPNETPOOL_THROTTLE_INTERVAL 50 // msecs between reads of a throttled transfer
+
+
+class XPNetPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Priority
+    {
+        Interactive, // the user is waiting, never queued
+        Normal,
+        Background   // prefetch, sync and revalidation, capped bandwidth
+    };
+
+    static XPNetPool *instance();
+
+    // Move the worker onto the hub's pool thread and invoke its doWork()
+    // slot once the hub has room for a transfer of that priority
+    void start(QObject *worker, const QUrl& url, Priority priority = Normal);
+    //
+    // Take a worker out of its queue, false once it has been given a slot
+    bool cancel(QObject *worker);
+
+    // Priority the worker was started with, call from the worker
+    static Priority priority(QObject *worker);
+    static QNetworkRequest::Priority requestPriority(QObject *worker);
+
+    // Token bucket shared by all background downloads, returns how many
+    // of the wanted bytes may be read now
+    bool isThrottled(QObject *worker);
+    qint64 takeBackgroundBytes(qint64 wanted);
+
+    // Connection manager shared by all transfers to the hub, call from a pool thread
+    QNetworkAccessManager *networkManager(const QUrl& url);
+
+    // Take what the hub advertises in a response, call from a pool thread
+    void noteCapabilities(const QUrl& url, QNetworkReply *reply);
+
+    // Whether PUTs to the hub may be sent gzip encoded, only once the hub
+    // has advertised it
+    bool acceptsGzip(const QUrl& url);
+    void setAcceptsGzip(const QUrl& url, bool accepts);
+
+    // Whether the hub takes delta patches, only once the hub has
+    // advertised it
+    bool acceptsDelta(const QUrl& url);
+    void setAcceptsDelta(const QUrl& url, bool accepts);
+
+private slots:
+    void onWorkerDestroyed(QObject *worker);
+
+private:
+    struct Hub
+    {
+        Hub() { active[Interactive] = active[Normal] = active[Background] = 0; }
+
+        int active[3]; // per priority
+        QList<QObject *> queued[3];
+    };
+
+    explicit XPNetPool(QObject *parent = 0);
+    ~XPNetPool();
+    //
+    void dispatch(const QString& hub);
+    void run(QObject *worker, const QString& hub, Priority priority);
+    static QString hubKey(const QUrl& url);
+
+private:
+    static XPNetPool *m_instance; // this is a singleton
+    static QMutex m_instanceMutex;
+    //
+    QList<QThread *> m_threads;
+    QThreadStorage<QObject *> m_managers; // per thread parent of the managers
+    //
+    QMutex m_mutex;
+    QHash<QString, bool> m_acceptsGzip;
+    QHash<QString, bool> m_acceptsDelta;
+    //
+    QHash<QString, Hub> m_hubs;
+    QHash<QObject *, QPair<QString, int> > m_running; // hub and priority, the key is never dereferenced
+    //
+    qint64 m_backgroundRate; // bytes per second
+    qint64 m_tokens;
+    qint64 m_bucketTime;
+    QElapsedTimer m_bucketClock;
+};
+
+#endif // XPNETPOOL_H
@@ -0,0 +1,176 @@
+// This module implements the cache sync of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#include <QUrl>
+#include <QFile>
+#include <QDebug>
+#include <QTimer>
+#include <QFileInfo>
+#include <QEventLoop>
+
+#include "xpnetfile.h"
+#include "xpnetbatch.h"
+#include "xpnetetagindex.h"
+#include "xpnetpackstore.h"
+#include "xpnetcachepolicy.h"
+#include "xpnetsync.h"
+
+// NOTES:
+// 1. The manifest is fetched like any other file, an unchanged manifest
+//    costs a single 304.
+// 2. A file is current when it is cached with the manifest's ETag and
+//    size, it is then marked as validated and not asked for again.
+// 3. The other files are fetched concurrently with XPNetFile::fetchMany().
+// 4. Files no longer listed are left to the cache manager, the profiles
+//    directory also holds local files such as sim.prf.
+// 5. The ETags must be written exactly as the hub sends the ETag header.
+// 6. A file whose loose copy the cache manager dropped is current when
+//    the pack holds that version, XPNetFile extracts it when asked for.
+//
+
+XPNetSync::XPNetSync(const QString& hostAddress, const QString& cachePath, QObject *parent)
+    : QObject(parent), m_hostAddress(hostAddress), m_cachePath(cachePath), m_manifest(0), m_batch(0),
+      m_finished(false), m_changedCount(0), m_currentCount(0)
+{
+}
+
+void XPNetSync::start()
+{
+    QUrl url = QUrl(QString("http://%1/%2").arg(m_hostAddress).arg(XPNETSYNC_MANIFEST));
+    QString localPath = QString("%1/%2").arg(m_cachePath).arg(XPNETSYNC_MANIFEST);
+
+    m_manifest = new XPNetFile(url, localPath, this);
+    connect(m_manifest, SIGNAL(finished(bool)), this, SLOT(onManifestFinished(bool)));
+    m_manifest->existsAsync();
+}
+
+bool XPNetSync::waitForFinished(int msecs)
+{
+    if (!m_finished)
+    {
+        QTimer timer;
+        QEventLoop loop;
+        timer.setSingleShot(true);
+        connect(&timer, SIGNAL(timeout()), &loop, SLOT(quit()));
+        connect(this, SIGNAL(finished(bool)), &loop, SLOT(quit()));
+        timer.start(msecs);
+        loop.exec();
+    }
+
+    return m_finished && m_errorString.isEmpty();
+}
+
+void XPNetSync::onManifestFinished(bool ok)
+{
+    if (!ok)
+    {
+        finish(QString("Unable to get manifest: %1").arg(m_manifest->errorString()));
+        return;
+    }
+
+    QFile file(m_manifest->localFilePath());
+    if (!file.open(QFile::ReadOnly))
+    {
+        finish(QString("Unable to read manifest: %1").arg(file.errorString()));
+        return;
+    }
+
+    // Compare each listed file with the cache
+    //
+    XPNetCachePolicy *policy = XPNetCachePolicy::instance();
+    QList<XPNetBatchItem> items;
+
+    while (!file.atEnd())
+    {
+        QByteArray line = file.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        QList<QByteArray> fields = line.split('\t');
+        QString path = QString::fromUtf8(fields.value(2));
+        if (fields.count() != 3 || path.isEmpty() || path.startsWith('/') || path.contains(".."))
+        {
+            qDebug() << "XPNetSync::onManifestFinished bad line=" << line;
+            continue;
+        }
+
+        QByteArray eTag = fields.at(0);
+        qint64 size = fields.at(1).toLongLong();
+        QString localPath = QString("%1/%2").arg(m_cachePath).arg(path);
+
+        QFileInfo fi(localPath);
+        bool current = fi.exists()
+            ? fi.size() == size && XPNetEtagIndex::instance()->value(localPath) == eTag
+            : XPNetPackStore::instance()->hasVersion(localPath, eTag, size);
+        if (current)
+        {
+            policy->setValidated(localPath);
+            m_currentCount++;
+        }
+        else
+        {
+            policy->expire(localPath);
+            items.append(XPNetBatchItem(QUrl(QString("http://%1/%2").arg(m_hostAddress).arg(path)), localPath));
+        }
+    }
+
+    m_changedCount = items.count();
+
+    qDebug() << "XPNetSync::onManifestFinished current=" << m_currentCount << "changed=" << m_changedCount;
+
+    if (items.isEmpty())
+    {
+        finish("");
+        return;
+    }
+
+    // Fetch only what changed, behind whatever the user asks for
+    m_batch = XPNetFile::fetchMany(items, XPNETBATCH_MAXINFLIGHT, this, XPNetPool::Background);
+    connect(m_batch, SIGNAL(finished()), this, SLOT(onBatchFinished()));
+}
+
+void XPNetSync::onBatchFinished()
+{
+    int failed = 0;
+    for (int i=0, n=m_batch->count(); i<n; i++)
+    {
+        if (!m_batch->isOk(i))
+        {
+            qDebug() << "XPNetSync::onBatchFinished file=" << m_batch->localFilePath(i)
+                     << "error=" << m_batch->errorString(i);
+            failed++;
+        }
+    }
+
+    if (failed)
+        finish(QString("%1 of %2 files failed to sync").arg(failed).arg(m_batch->count()));
+    else
+        finish("");
+}
+
+void XPNetSync::finish(const QString& errorString)
+{
+    m_errorString = errorString;
+    m_finished = true;
+
+    emit finished(m_errorString.isEmpty());
+}
+
+// End of file
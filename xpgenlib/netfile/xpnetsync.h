@@ -0,0 +1,74 @@
+// This module defines the cache sync of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#ifndef XPNETSYNC_H
+#define XPNETSYNC_H
+
+#include <QObject>
+#include <QString>
+
+#define XPNETSYNC_MANIFEST "profiles/.manifest"
+
+class XPNetFile;
+class XPNetBatch;
+
+
+/*
+ * Brings the cached profiles up to date from the hub's manifest,
+ * one line per file: <etag> TAB <size> TAB <path below the web root>
+ */
+
+class XPNetSync : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit XPNetSync(const QString& hostAddress, const QString& cachePath, QObject *parent = 0);
+
+    void start();
+    bool isFinished() { return m_finished; }
+    bool waitForFinished(int msecs = 60000);
+
+    int changedCount() { return m_changedCount; }
+    int currentCount() { return m_currentCount; }
+    QString errorString() { return m_errorString; }
+
+signals:
+    void finished(bool ok);
+
+private slots:
+    void onManifestFinished(bool ok);
+    void onBatchFinished();
+
+private:
+    void finish(const QString& errorString);
+
+private:
+    QString m_hostAddress;
+    QString m_cachePath;
+    XPNetFile *m_manifest;
+    XPNetBatch *m_batch;
+    bool m_finished;
+    int m_changedCount;
+    int m_currentCount;
+    QString m_errorString;
+};
+
+#endif // XPNETSYNC_H
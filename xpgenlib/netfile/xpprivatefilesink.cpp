@@ -0,0 +1,145 @@
+// This module implements the private file sink of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#ifdef LINUX_PLATFORM
+#include <fcntl.h>
+#endif
+
+#include <QDebug>
+
+#include "xpprivatefilesink.h"
+
+// NOTES:
+// 1. Network data is read straight into one reusable buffer.
+// 2. The buffer goes to disk in XPPRIVATEFILESINK_CHUNK sized writes.
+// 3. The file is preallocated from the Content-Length (Linux only).
+// 4. Opening at an offset writes into an existing file (resume or range).
+//
+
+XPPrivateFileSink::XPPrivateFileSink()
+    : m_used(0), m_pos(0), m_trim(false)
+{
+}
+
+XPPrivateFileSink::~XPPrivateFileSink()
+{
+    if (m_file.isOpen())
+        close();
+}
+
+bool XPPrivateFileSink::open(const QString& filePath, qint64 expectedSize)
+{
+    if (!openFile(filePath, QFile::WriteOnly | QFile::Truncate, 0))
+        return false;
+
+    // Reserve the disk space up front without changing the file size,
+    // so a partial file never looks longer than what was written
+#ifdef LINUX_PLATFORM
+    if (expectedSize > 0)
+        fallocate(m_file.handle(), FALLOC_FL_KEEP_SIZE, 0, expectedSize);
+#else
+    Q_UNUSED(expectedSize);
+#endif
+
+    m_trim = true;
+    return true;
+}
+
+bool XPPrivateFileSink::openAt(const QString& filePath, qint64 offset)
+{
+    // Other writers may own the data beyond this one so never trim
+    m_trim = false;
+    return openFile(filePath, QFile::ReadWrite, offset);
+}
+
+bool XPPrivateFileSink::openFile(const QString& filePath, QIODevice::OpenMode mode, qint64 offset)
+{
+    m_used = 0;
+    m_pos = offset;
+    m_errorString = "";
+    m_buffer.resize(XPPRIVATEFILESINK_CHUNK);
+
+    m_file.setFileName(filePath);
+    if (!m_file.open(mode | QFile::Unbuffered))
+    {
+        m_errorString = m_file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+qint64 XPPrivateFileSink::readFrom(QIODevice *device, qint64 maxSize)
+{
+    qint64 total = 0;
+
+    while (m_file.isOpen() && (maxSize < 0 || total < maxSize))
+    {
+        qint64 len = m_buffer.size()-m_used;
+        if (maxSize >= 0)
+            len = qMin(len, maxSize-total);
+
+        qint64 n = device->read(m_buffer.data()+m_used, len);
+        if (n <= 0)
+            break;
+
+        total += n;
+        m_used += n;
+
+        // Write only whole chunks while the transfer is running
+        if (m_used == m_buffer.size() && !flush())
+            break;
+    }
+
+    return total;
+}
+
+bool XPPrivateFileSink::close()
+{
+    bool ok = flush();
+
+    // Trim any preallocated space that was not used
+    if (m_trim && m_file.size() != m_pos)
+        m_file.resize(m_pos);
+    m_file.close();
+
+    return ok && m_errorString.isEmpty();
+}
+
+bool XPPrivateFileSink::flush()
+{
+    if (m_used == 0)
+        return true;
+
+    if (!m_file.seek(m_pos) || m_file.write(m_buffer.constData(), m_used) != m_used)
+    {
+        m_errorString = m_file.errorString();
+        qDebug() << "XPPrivateFileSink::flush error=" << m_errorString;
+        m_file.close();
+        return false;
+    }
+
+    m_pos += m_used;
+    m_used = 0;
+
+    return true;
+}
+
+// End of file
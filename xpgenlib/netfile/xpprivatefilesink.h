@@ -0,0 +1,62 @@
+// This module defines the private file sink of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#ifndef XPPRIVATEFILESINK_H
+#define XPPRIVATEFILESINK_H
+
+#include <QFile>
+#include <QString>
+#include <QIODevice>
+#include <QByteArray>
+
+#define XPPRIVATEFILESINK_CHUNK (64*1024)
+
+
+class XPPrivateFileSink
+{
+public:
+    XPPrivateFileSink();
+    ~XPPrivateFileSink();
+
+    // Start a new file, expectedSize is the Content-Length if known
+    bool open(const QString& filePath, qint64 expectedSize = -1);
+    // Write into an existing file from offset (resume or range segment)
+    bool openAt(const QString& filePath, qint64 offset);
+    qint64 readFrom(QIODevice *device, qint64 maxSize = -1); // -1 reads all available
+    bool close();
+
+    bool isOpen() { return m_file.isOpen(); }
+    qint64 size() { return m_pos + m_used; }
+    QString errorString() { return m_errorString; }
+
+private:
+    bool openFile(const QString& filePath, QIODevice::OpenMode mode, qint64 offset);
+    bool flush();
+
+private:
+    QFile m_file;
+    QByteArray m_buffer; // reused for every read
+    int m_used;
+    qint64 m_pos;
+    bool m_trim;
+    QString m_errorString;
+};
+
+#endif // XPPRIVATEFILESINK_H
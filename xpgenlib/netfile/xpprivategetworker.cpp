@@ -19,40 +19,60 @@
 // WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
 
 #include <QDebug>
-#include <QMutex>
-#include <QSettings>
 #include <QFileInfo>
-#include <QWaitCondition>
 #include <QNetworkRequest>
 
+#include "xpnetpool.h"
+#include "xpnetetagindex.h"
+#include "xpnetcachepolicy.h"
+#include "xpnetcachemanager.h"
+#include "xpnetpackstore.h"
+#include "xpnetfileutil.h"
 #include "xpprivategetworker.h"
 
 //
 // XPPrivateGetWorker
 //
 
+XPPrivateGetWorker::~XPPrivateGetWorker()
+{
+    qDeleteAll(m_segmentSinks);
+}
+
 void XPPrivateGetWorker::doWork()
 {
+    // Aborted after the slot was given, the slot goes with the worker
+    if (m_aborted)
+    {
+        deleteLater();
+        return;
+    }
+
     m_readyReadFlag = false;
+    m_stats.start();
 
-    // Backup original file
-    m_file.setFileName(m_controller->localFilePath());
-    QFile::remove(m_controller->localFilePath()+"~");
-    QFile::copy(m_controller->localFilePath(), m_controller->localFilePath()+"~");
+    // Download into a sibling temp file, the cached file is left alone
+    m_partPath = m_localPath+XPNETFILE_PARTSUFFIX;
 
-    // Open a network manager to do the file transfer
-    m_netManager = new QNetworkAccessManager(this);
+    // Use the hub's shared network manager to reuse its connections
+    m_netManager = XPNetPool::instance()->networkManager(m_url);
 
     // Build the request
     QNetworkRequest request;
-    request.setUrl(m_controller->m_url);
+    request.setUrl(m_url);
+    request.setAttribute(QNetworkRequest::HttpPipeliningAllowedAttribute, true);
+    request.setPriority(XPNetPool::requestPriority(this));
+
+    // Leave Accept-Encoding unset, QNetworkAccessManager then asks for
+    // "gzip, deflate" itself and decompresses the reply transparently
+    // (setting the header by hand turns the decompression off)
 
-    qDebug() << "Executing GET request =" << m_file.fileName();
+    qDebug() << "Executing GET request =" << m_localPath;
 
 #ifdef XPNETFILE_USE_ETAG
-    // Get eTag from the tag cache file
-    QByteArray eTag = recoverFileEtag();
-    if (!eTag.isEmpty() && m_file.exists())
+    // Get eTag from the cache wide ETag index
+    QByteArray eTag = XPNetEtagIndex::instance()->value(m_localPath);
+    if (!eTag.isEmpty() && QFile::exists(m_localPath))
     {
         // Add "If-None-Match" header
         request.setRawHeader(QString("If-None-Match").toLatin1(), eTag);
@@ -60,101 +80,423 @@ void XPPrivateGetWorker::doWork()
     }
 #endif
 
+    // Resume a partial download if the server still has the same version
+    QByteArray partTag = XPNetEtagIndex::instance()->value(m_partPath);
+    QFileInfo part(m_partPath);
+    if (!partTag.isEmpty() && part.exists() && part.size() > 0)
+    {
+        m_resumeOffset = part.size();
+        request.setRawHeader("Range", QString("bytes=%1-").arg(m_resumeOffset).toLatin1());
+        request.setRawHeader("If-Range", partTag);
+        request.setRawHeader("Accept-Encoding", "identity"); // ranges of the plain file
+        qDebug() << ">> onDoWork() resume from=" << m_resumeOffset << "etag=" << partTag;
+    }
+    else
+    {
+        discardPart();
+    }
+
     // GET request is asynchronous
     m_netReply = m_netManager->get(request);
+
+    // A small read buffer lets TCP hold back what the bucket won't take yet
+    m_throttled = XPNetPool::instance()->isThrottled(this);
+    if (m_throttled)
+    {
+        m_netReply->setReadBufferSize(XPPRIVATEFILESINK_CHUNK);
+        m_throttleTimer = new QTimer(this);
+        m_throttleTimer->setSingleShot(true);
+        connect(m_throttleTimer, SIGNAL(timeout()), this, SLOT(onReadyRead()));
+    }
+
+    connect(m_netReply, SIGNAL(metaDataChanged()), this, SLOT(onMetaDataChanged()));
     connect(m_netReply, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
     connect(m_netReply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(onError(QNetworkReply::NetworkError)));
     connect(m_netReply, SIGNAL(finished()), this, SLOT(onFinished()));
 }
 
+void XPPrivateGetWorker::abort()
+{
+    // Still waiting for a slot, nobody wants the transfer any more
+    m_aborted = true;
+    if (XPNetPool::instance()->cancel(this))
+    {
+        deleteLater();
+        return;
+    }
+
+    // The replies report OperationCanceledError and then finish
+    if (m_netReply && m_netReply->isRunning())
+        m_netReply->abort();
+
+    for (int i=0, n=m_segments.count(); i<n; i++)
+    {
+        if (m_segments.at(i)->isRunning())
+            m_segments.at(i)->abort();
+    }
+}
+
+void XPPrivateGetWorker::onMetaDataChanged()
+{
+    m_stats.markFirstByte();
+    int status = httpStatus(m_netReply);
+    XPNetPool::instance()->noteCapabilities(m_url, m_netReply);
+
+    // Make sure a resumed download carries on where the file ends
+    if (status == 206)
+    {
+        QByteArray range = m_netReply->rawHeader("Content-Range"); // bytes start-end/total
+        qint64 start = range.mid(6, range.indexOf('-')-6).toLongLong();
+        if (!range.startsWith("bytes ") || start != m_resumeOffset)
+        {
+            m_errorString = QString("Unexpected content range=%1").arg(QString(range));
+            discardPart();
+            m_netReply->abort();
+        }
+        return;
+    }
+
+    if (status != 200)
+        return;
+
+    // A 200 to a resume request means the file changed, start over
+    m_resumeOffset = 0;
+
+    // Split a large file into ranges fetched on several connections
+    QVariant length = m_netReply->header(QNetworkRequest::ContentLengthHeader);
+    QByteArray eTag = m_netReply->rawHeader("ETag");
+    if (XPNETFILE_SEGMENTS > 1 && !m_throttled && XPNetPool::priority(this) != XPNetPool::Background
+        && length.isValid() && length.toLongLong() >= XPNETFILE_SEGMENT_MINSIZE
+        && !eTag.isEmpty()
+        && m_netReply->rawHeader("Accept-Ranges") == "bytes"
+        && m_netReply->rawHeader("Content-Encoding").isEmpty())
+    {
+        if (startSegments(length.toLongLong(), eTag))
+        {
+            m_segmented = true;
+            m_netReply->abort();
+        }
+    }
+}
+
 void XPPrivateGetWorker::onReadyRead()
 {
     qDebug() << ">> onReadyRead() bytesAvailable=" << m_netReply->bytesAvailable();
     m_readyReadFlag = true;
 
-    // Open the file for writing
-    if (!m_file.isOpen())
-        m_file.open(QFile::WriteOnly);
+    // Only a 200 or a resumed 206 carries file content, drop error pages
+    int status = httpStatus(m_netReply);
+    if (m_segmented || (status != 200 && status != 206))
+    {
+        m_stats.addBytesIn(m_netReply->readAll().size());
+        return;
+    }
+
+    // Open the temp file for writing, sized from the Content-Length
+    if (!m_sink.isOpen() && m_sink.errorString().isEmpty())
+    {
+        bool ok;
+        if (status == 206)
+            ok = m_sink.openAt(m_partPath, m_resumeOffset);
+        else
+        {
+            QVariant length = m_netReply->header(QNetworkRequest::ContentLengthHeader);
+            ok = m_sink.open(m_partPath, length.isValid() ? length.toLongLong() : -1);
+
+            // Remember which version the temp file holds so it can be resumed,
+            // only a plain body is sure to be the file's leading bytes
+            QByteArray eTag = m_netReply->rawHeader("ETag");
+            if (!eTag.isEmpty() && m_netReply->rawHeader("Content-Encoding").isEmpty())
+                XPNetEtagIndex::instance()->setValue(m_partPath, eTag);
+            else
+                XPNetEtagIndex::instance()->remove(m_partPath);
+        }
+
+        if (!ok)
+            qDebug() << ">> onReadyRead() open error=" << m_sink.errorString();
+    }
 
-    // write available data to the local file
-    if (m_file.isOpen())
-        m_file.write(m_netReply->readAll());
+    // Stream available data through the sink's buffer to the temp file
+    if (m_sink.isOpen() && m_throttled)
+    {
+        // Read what the bucket allows and come back for the rest
+        qint64 allowed = XPNetPool::instance()->takeBackgroundBytes(m_netReply->bytesAvailable());
+        m_stats.addBytesIn(m_sink.readFrom(m_netReply, allowed));
+        if (m_netReply->bytesAvailable() > 0 && !m_throttleTimer->isActive())
+            m_throttleTimer->start(XPNETPOOL_THROTTLE_INTERVAL);
+    }
+    else if (m_sink.isOpen())
+        m_stats.addBytesIn(m_sink.readFrom(m_netReply));
+    else // keep the reply from buffering what can't be written
+        m_stats.addBytesIn(m_netReply->readAll().size());
 }
 
 void XPPrivateGetWorker::onError(QNetworkReply::NetworkError netError)
 {
-    // Close file
-    if (m_file.isOpen())
-        m_file.close();
-
-    // Remove downloaded file and rename original file
-    m_file.remove();
-    QFile::rename(m_controller->localFilePath()+"~", m_controller->localFilePath());
+    // Aborted on purpose to fetch the file in segments
+    if (m_segmented)
+        return;
 
-    m_errorString = m_netReply->errorString();
-
-    wakeController();
+    if (m_errorString.isEmpty())
+        m_errorString = m_netReply->errorString();
 
     qDebug() << ">> onError=" << netError << "msg=" << m_errorString;
 }
 
 void XPPrivateGetWorker::onFinished()
 {
-    // Close the file
-    if (m_file.isOpen())
-        m_file.close();
+    // The range segments finish the transfer
+    if (m_segmented)
+        return;
 
-    // If no data downloaded restore original file from backup
-    //if (m_readyReadFlag == false)
-    //    QFile::rename(m_controller->localFilePath()+"~", m_controller->localFilePath());
+    // Write out what is left and close the temp file
+    bool written = true;
+    if (m_sink.isOpen())
+    {
+        m_stats.addBytesIn(m_sink.readFrom(m_netReply));
+        written = m_sink.close();
+    }
+    else if (!m_sink.errorString().isEmpty())
+        written = false;
 
-#ifdef XPNETFILE_USE_ETAG
-    //qDebug() << ">> " << m_netReply->rawHeaderList();
+    if (m_errorString.isEmpty() && !written)
+        m_errorString = QString("Unable to write cached file=%1").arg(m_localPath);
 
-    // Get the ETag header from the reply and save it
+    int status = httpStatus(m_netReply);
     QByteArray eTag = m_netReply->rawHeader(QByteArray("ETag"));
-    if (!eTag.isEmpty())
-        saveFileEtag(eTag);
+
+    if (m_errorString.isEmpty() && (status == 200 || status == 206))
+    {
+        // A 200 or a completed resume replaces the cached file in one step
+        if (eTag.isEmpty() && status == 206)
+            eTag = XPNetEtagIndex::instance()->value(m_partPath);
+        commitFile(eTag);
+    }
+    else if (m_errorString.isEmpty())
+    {
+        // A 304 touches nothing on disk but a stale temp file
+        discardPart();
+#ifdef XPNETFILE_USE_ETAG
+        if (!eTag.isEmpty())
+            XPNetEtagIndex::instance()->setValue(m_localPath, eTag, false);
 #endif
+        if (status == 304)
+        {
+            XPNetCachePolicy::instance()->setValidated(m_localPath);
+            XPNetCacheManager::instance()->recordHit(m_localPath);
+
+            // Files cached before the pack was turned on go in now
+            if (XPNetPackStore::instance()->isEnabled() && !XPNetPackStore::instance()->isPacked(m_localPath))
+                XPNetPackStore::instance()->store(m_localPath);
+        }
+    }
+    else if (status >= 400 || XPNetEtagIndex::instance()->value(m_partPath).isEmpty())
+    {
+        // Keep a partial file only while it can be resumed
+        discardPart();
+    }
+
+    // Don't ask for a file the hub doesn't have again for a while
+    if (status == 404 || status == 410)
+        XPNetCachePolicy::instance()->setMissing(m_url);
 
+    // onError() has already run for failed transfers
     wakeController();
 
     qDebug() << ">> onFinished() transfer complete!";
 }
 
-void XPPrivateGetWorker::wakeController()
+bool XPPrivateGetWorker::startSegments(qint64 totalSize, const QByteArray& eTag)
 {
-    emit finished();
+    // Size the temp file so every segment can write at its own offset
+    QFile part(m_partPath);
+    if (!part.open(QFile::WriteOnly | QFile::Truncate) || !part.resize(totalSize))
+        return false;
+    part.close();
+
+    // Segmented downloads are not resumed
+    XPNetEtagIndex::instance()->remove(m_partPath);
+    m_segmentETag = eTag;
+
+    qint64 segmentSize = (totalSize + XPNETFILE_SEGMENTS - 1) / XPNETFILE_SEGMENTS;
+    for (qint64 start = 0; start < totalSize; start += segmentSize)
+    {
+        qint64 end = qMin(start + segmentSize, totalSize) - 1;
+
+        XPPrivateFileSink *sink = new XPPrivateFileSink;
+        m_segmentSinks.append(sink);
+        if (!sink->openAt(m_partPath, start))
+        {
+            m_errorString = sink->errorString();
+            break;
+        }
+
+        QNetworkRequest request;
+        request.setUrl(m_url);
+        request.setPriority(XPNetPool::requestPriority(this));
+        request.setRawHeader("Range", QString("bytes=%1-%2").arg(start).arg(end).toLatin1());
+        request.setRawHeader("If-Range", eTag);
+        request.setRawHeader("Accept-Encoding", "identity"); // ranges of the plain file
+
+        QNetworkReply *reply = m_netManager->get(request);
+        connect(reply, SIGNAL(readyRead()), this, SLOT(onSegmentReadyRead()));
+        connect(reply, SIGNAL(finished()), this, SLOT(onSegmentFinished()));
+        m_segments.append(reply);
+        m_segmentsPending++;
+    }
+
+    // Fall back to the single reply if a segment could not start
+    if (!m_errorString.isEmpty())
+    {
+        qDebug() << ">> startSegments() error=" << m_errorString;
+        m_errorString = "";
+        m_segmentsPending = 0;
+        for (int i=0, n=m_segments.count(); i<n; i++)
+        {
+            m_segments.at(i)->disconnect(this);
+            m_segments.at(i)->abort();
+            m_segments.at(i)->deleteLater();
+        }
+        m_segments.clear();
+        qDeleteAll(m_segmentSinks);
+        m_segmentSinks.clear();
+        QFile::remove(m_partPath);
+        return false;
+    }
+
+    qDebug() << ">> startSegments() size=" << totalSize << "segments=" << m_segments.count();
+
+    return true;
 }
 
-#ifdef XPNETFILE_USE_ETAG
-//
-// ETags saved in ".xpetagcache" file in same folder as target file
-//
+void XPPrivateGetWorker::onSegmentReadyRead()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+    int index = m_segments.indexOf(reply);
+    if (index < 0)
+        return;
+
+    // Anything but a 206 fails the segment when it finishes
+    XPPrivateFileSink *sink = m_segmentSinks.at(index);
+    if (httpStatus(reply) == 206 && sink->isOpen())
+        m_stats.addBytesIn(sink->readFrom(reply));
+    else
+        m_stats.addBytesIn(reply->readAll().size());
+}
 
-void XPPrivateGetWorker::saveFileEtag(QByteArray &eTag)
+void XPPrivateGetWorker::onSegmentFinished()
 {
-    QFileInfo fi(m_file.fileName());
-    QString basePath = fi.filePath().remove(fi.fileName());
-    QString key = QString("%1/etag").arg(fi.fileName());
-    QSettings etagFile(basePath+"/.xpetagcache", QSettings::IniFormat);
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+    int index = m_segments.indexOf(reply);
+    if (index < 0)
+        return;
+
+    XPPrivateFileSink *sink = m_segmentSinks.at(index);
+    bool written = true;
+    if (sink->isOpen())
+    {
+        if (httpStatus(reply) == 206)
+            m_stats.addBytesIn(sink->readFrom(reply));
+        written = sink->close();
+    }
+
+    if (m_errorString.isEmpty())
+    {
+        if (reply->error() != QNetworkReply::NoError)
+            m_errorString = reply->errorString();
+        else if (httpStatus(reply) != 206)
+            m_errorString = "File changed on the server during download";
+        else if (!written)
+            m_errorString = QString("Unable to write cached file=%1").arg(m_localPath);
+    }
+
+    // Aborting the others below finishes them too, only the last one completes
+    bool last = (--m_segmentsPending == 0);
+
+    // One failed segment fails the whole transfer
+    if (!m_errorString.isEmpty())
+        abort();
+
+    if (!last)
+        return;
 
-    etagFile.setValue(key, eTag);
+    if (m_errorString.isEmpty())
+        commitFile(m_segmentETag);
+    else
+        discardPart();
 
-    //qDebug() << "XPPrivateGetWorker::saveFileEtag() name=" << fi.fileName() << "etag=" << eTag;
+    wakeController();
+
+    qDebug() << ">> onSegmentFinished() transfer complete!";
 }
 
-QByteArray XPPrivateGetWorker::recoverFileEtag()
+void XPPrivateGetWorker::commitFile(const QByteArray& eTag)
 {
-    QFileInfo fi(m_file.fileName());
-    QString basePath = fi.filePath().remove(fi.fileName());
-    QString key = QString("%1/etag").arg(fi.fileName());
-    QSettings etagFile(basePath+"/.xpetagcache", QSettings::IniFormat);
+    // Empty files never see readyRead()
+    if (!QFile::exists(m_partPath))
+    {
+        QFile empty(m_partPath);
+        empty.open(QFile::WriteOnly);
+    }
 
-    return etagFile.value(key).toByteArray();
+    if (!XPNetFileUtil::replaceFile(m_partPath, m_localPath))
+        m_errorString = QString("Unable to replace cached file=%1").arg(m_localPath);
+    else
+        XPNetCachePolicy::instance()->setValidated(m_localPath);
+    discardPart();
 
-    //qDebug() << "XPPrivateGetWorker::wakeController name=" << fi.fileName() << "base=" << basePath;
-}
+    if (!m_errorString.isEmpty())
+        return;
+
+#ifdef XPNETFILE_USE_ETAG
+    // New content without a tag must not keep the old one
+    if (!eTag.isEmpty())
+        XPNetEtagIndex::instance()->setValue(m_localPath, eTag);
+    else
+        XPNetEtagIndex::instance()->remove(m_localPath);
+
+    // The pack keeps a copy under its ETag
+    if (!eTag.isEmpty())
+        XPNetPackStore::instance()->store(m_localPath);
+#else
+    Q_UNUSED(eTag);
 #endif
 
+    // Counted once its ETag record is in place
+    XPNetCacheManager::instance()->recordMiss(m_localPath);
+}
+
+void XPPrivateGetWorker::discardPart()
+{
+    QFile::remove(m_partPath);
+    XPNetEtagIndex::instance()->remove(m_partPath);
+}
+
+int XPPrivateGetWorker::httpStatus(QNetworkReply *reply)
+{
+    return reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+}
+
+void XPPrivateGetWorker::wakeController()
+{
+    if (m_throttleTimer)
+        m_throttleTimer->stop();
+
+    int status = m_netReply ? httpStatus(m_netReply) : 0;
+    if (!m_errorString.isEmpty())
+        m_stats.record("GET", m_url, status, XPNetMetrics::Failed);
+    else
+        m_stats.record("GET", m_url, status, status == 304 ? XPNetMetrics::NotModified : XPNetMetrics::Fetched);
+
+    if (m_netReply)
+        m_netReply->deleteLater();
+    for (int i=0, n=m_segments.count(); i<n; i++)
+        m_segments.at(i)->deleteLater();
+
+    emit finished(m_errorString);
+
+    // The worker lives on a pool thread and is no longer needed
+    deleteLater();
+}
+
 // End of file
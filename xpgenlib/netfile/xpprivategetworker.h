@@ -24,10 +24,14 @@
 //#include "xpgenlib-mobile_global.h"
 
 #include <QFile>
+#include <QList>
+#include <QTimer>
 #include <QNetworkReply>
 #include <QNetworkAccessManager>
 
 #include "xpnetfile.h"
+#include "xpnetmetrics.h"
+#include "xpprivatefilesink.h"
 
 
 class XPPrivateGetWorker : public QObject
@@ -35,37 +39,57 @@ class XPPrivateGetWorker : public QObject
     Q_OBJECT
 
 public:
-    explicit XPPrivateGetWorker(XPNetFile* controller, QObject *parent = 0)
-                : QObject(parent), m_controller(controller) {}
-
-    QString errorString() { return m_errorString; }
+    explicit XPPrivateGetWorker(const QUrl& url, const QString& localPath, QObject *parent = 0)
+                : QObject(parent), m_url(url), m_localPath(localPath), m_resumeOffset(0),
+                  m_segmented(false), m_segmentsPending(0), m_throttled(false), m_throttleTimer(0),
+                  m_netReply(0), m_netManager(0), m_aborted(false) {}
+    ~XPPrivateGetWorker();
 
 signals:
-    void finished();
+    void finished(QString errorString);
 
 public slots:
     void doWork();
+    void abort();
 
 private slots:
+    void onMetaDataChanged();
     void onReadyRead();
     void onError(QNetworkReply::NetworkError netError);
     void onFinished();
+    void onSegmentReadyRead();
+    void onSegmentFinished();
 
 private:
     void wakeController();
-#ifdef XPNETFILE_USE_ETAG
-    void saveFileEtag(QByteArray& eTag);
-    QByteArray recoverFileEtag();
-#endif
+    bool startSegments(qint64 totalSize, const QByteArray& eTag);
+    void commitFile(const QByteArray& eTag);
+    void discardPart();
+    int httpStatus(QNetworkReply *reply);
 
 private:
-    XPNetFile* m_controller;
+    QUrl m_url;
+    QString m_localPath;
     //
     bool m_readyReadFlag;
-    QFile m_file;
+    QString m_partPath;
+    qint64 m_resumeOffset;
+    XPPrivateFileSink m_sink;
+    //
+    bool m_segmented;
+    int m_segmentsPending;
+    QByteArray m_segmentETag;
+    QList<QNetworkReply *> m_segments;
+    QList<XPPrivateFileSink *> m_segmentSinks;
+    //
+    bool m_throttled; // background download under the pool's bandwidth cap
+    QTimer *m_throttleTimer;
+    //
+    XPNetTransferStats m_stats;
     QString m_errorString;
     QNetworkReply* m_netReply;
     QNetworkAccessManager *m_netManager;
+    bool m_aborted; // before doWork() ran, it does nothing
 };
 
 #endif // XPPRIVATEGETWORKER_H
@@ -0,0 +1,148 @@
+// This module implements the private head worker of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later 
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#include <QFile>
+#include <QDebug>
+#include <QFileInfo>
+#include <QNetworkRequest>
+
+#include "xpnetpool.h"
+#include "xpnetetagindex.h"
+#include "xpnetcachepolicy.h"
+#include "xpprivateheadworker.h"
+
+// NOTES:
+// 1. A HEAD request returns the hub file's metadata without its content.
+// 2. The cached file's ETag goes in If-None-Match, a 304 or a matching
+//    ETag confirms the cached file like a conditional GET would.
+// 3. The size is that of the plain file (Accept-Encoding: identity).
+//
+
+//
+// XPPrivateHeadWorker
+//
+
+void XPPrivateHeadWorker::doWork()
+{
+    // Aborted after the slot was given, the slot goes with the worker
+    if (m_aborted)
+    {
+        deleteLater();
+        return;
+    }
+
+    m_stats.start();
+
+    // Use the hub's shared network manager to reuse its connections
+    m_netManager = XPNetPool::instance()->networkManager(m_url);
+
+    // Build the request
+    QNetworkRequest request;
+    request.setUrl(m_url);
+    request.setPriority(XPNetPool::requestPriority(this));
+    request.setRawHeader("Accept-Encoding", "identity");
+
+    if (!m_localPath.isEmpty() && QFile::exists(m_localPath))
+    {
+        m_cachedETag = XPNetEtagIndex::instance()->value(m_localPath);
+        if (!m_cachedETag.isEmpty())
+            request.setRawHeader("If-None-Match", m_cachedETag);
+    }
+
+    // HEAD request is asynchronous
+    m_netReply = m_netManager->head(request);
+    connect(m_netReply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(onError(QNetworkReply::NetworkError)));
+    connect(m_netReply, SIGNAL(finished()), this, SLOT(onFinished()));
+
+    qDebug() << "Executing HEAD request =" << m_url;
+}
+
+void XPPrivateHeadWorker::abort()
+{
+    // Still waiting for a slot, nobody wants the transfer any more
+    m_aborted = true;
+    if (XPNetPool::instance()->cancel(this))
+    {
+        deleteLater();
+        return;
+    }
+
+    // The reply reports OperationCanceledError and then finishes
+    if (m_netReply && m_netReply->isRunning())
+        m_netReply->abort();
+}
+
+void XPPrivateHeadWorker::onError(QNetworkReply::NetworkError netError)
+{
+    m_errorString = m_netReply->errorString();
+
+    qDebug() << ">> onError=" << netError << "msg=" << m_errorString;
+}
+
+void XPPrivateHeadWorker::onFinished()
+{
+    int status = m_netReply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    m_stats.markFirstByte();
+    XPNetPool::instance()->noteCapabilities(m_url, m_netReply);
+
+    if (status == 304)
+    {
+        // The cached file is the hub's version
+        QFileInfo fi(m_localPath);
+        XPNetCachePolicy::instance()->setValidated(m_localPath);
+        emit statReady(fi.size(), m_cachedETag, m_netReply->header(QNetworkRequest::LastModifiedHeader).toDateTime());
+    }
+    else if (status == 200)
+    {
+        QVariant length = m_netReply->header(QNetworkRequest::ContentLengthHeader);
+        QByteArray eTag = m_netReply->rawHeader("ETag");
+        if (!eTag.isEmpty() && eTag == m_cachedETag)
+            XPNetCachePolicy::instance()->setValidated(m_localPath);
+
+        emit statReady(length.isValid() ? length.toLongLong() : -1, eTag,
+                       m_netReply->header(QNetworkRequest::LastModifiedHeader).toDateTime());
+    }
+    else if (status == 404 || status == 410)
+    {
+        XPNetCachePolicy::instance()->setMissing(m_url);
+    }
+
+    if (!m_errorString.isEmpty() || (status != 200 && status != 304))
+        m_stats.record("HEAD", m_url, status, XPNetMetrics::Failed);
+    else
+        m_stats.record("HEAD", m_url, status, status == 304 ? XPNetMetrics::NotModified : XPNetMetrics::Fetched);
+
+    wakeController();
+
+    qDebug() << ">> onFinished() head status=" << status;
+}
+
+void XPPrivateHeadWorker::wakeController()
+{
+    if (m_netReply)
+        m_netReply->deleteLater();
+
+    emit finished(m_errorString);
+
+    // The worker lives on a pool thread and is no longer needed
+    deleteLater();
+}
+
+// End of file
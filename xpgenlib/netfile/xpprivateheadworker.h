@@ -0,0 +1,69 @@
+// This module defines the private head worker of the XPGENLIB library.
+//
+// Copyright (c) 2015 Xped Holdings Limited <info@xped.com>
+//
+// This file is part of the Equinox.
+//
+// This file may be used under the terms of the GNU General Public
+// License version 3.0 as published by the Free Software Foundation
+// and appearing in the file LICENSE included in the packaging of
+// this file. Alternatively you may (at your option) use any later 
+// version of the GNU General Public License if such license has been
+// publicly approved by Xped Holdings Limited (or its successors,
+// if any) and the KDE Free Qt Foundation.
+//
+// If you are unsure which license is appropriate for your use, please
+// contact the sales department at sales@xped.com.
+//
+// This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+// WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+#ifndef XPPRIVATEHEADWORKER_H
+#define XPPRIVATEHEADWORKER_H
+
+#include <QDateTime>
+#include <QByteArray>
+#include <QNetworkReply>
+#include <QNetworkAccessManager>
+
+#include "xpnetfile.h"
+#include "xpnetmetrics.h"
+
+
+class XPPrivateHeadWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit XPPrivateHeadWorker(const QUrl& url, const QString& localPath, QObject *parent = 0)
+                : QObject(parent), m_url(url), m_localPath(localPath), m_netReply(0), m_netManager(0),
+                  m_aborted(false) {}
+
+signals:
+    void statReady(qint64 size, QByteArray eTag, QDateTime lastModified);
+    void finished(QString errorString);
+
+public slots:
+    void doWork();
+    void abort();
+
+private slots:
+    void onError(QNetworkReply::NetworkError netError);
+    void onFinished();
+
+private:
+    void wakeController();
+
+private:
+    QUrl m_url;
+    QString m_localPath;
+    QByteArray m_cachedETag;
+    //
+    XPNetTransferStats m_stats;
+    QString m_errorString;
+    QNetworkReply* m_netReply;
+    QNetworkAccessManager *m_netManager;
+    bool m_aborted; // before doWork() ran, it does nothing
+};
+
+#endif // XPPRIVATEHEADWORKER_H
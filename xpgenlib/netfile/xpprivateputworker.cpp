@@ -19,67 +19,273 @@
 // WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
 
 #include <QDebug>
-#include <QMutex>
-#include <QWaitCondition>
+#include <QFileInfo>
 #include <QNetworkRequest>
 
+#include "xpnetpool.h"
+#include "xpnetetagindex.h"
+#include "xpnetpackstore.h"
 #include "xpprivateputworker.h"
 
+// NOTES:
+// 1. The body is gzipped when the hub has advertised it takes that
+//    (Content-Encoding: gzip). It is compressed into a temporary file
+//    first, a sequential body without a Content-Length would be buffered
+//    whole in memory by QNetworkAccessManager.
+// 2. A hub answering 400, 415 or 501 to a gzip body is marked in the
+//    XPNetPool and the file is sent again uncompressed.
+// 3. With a signature of the hub's version only a patch is sent, with
+//    If-Match so the hub applies it to that version alone. A hub that
+//    refuses the patch (412, 400, 415 or 501) gets the whole file.
+// 4. The hub's ETag for the new version becomes the cached file's ETag.
+// 5. A buffer is sent the same way as a file, without a patch.
+//
+
+static bool gzipTo(QIODevice *source, QFile *target)
+{
+    XPGzipDevice gzip(source);
+    if (!gzip.open(QIODevice::ReadOnly))
+        return false;
+
+    QByteArray chunk(XPGZIPDEVICE_CHUNK, 0);
+    qint64 n;
+    while ((n = gzip.read(chunk.data(), chunk.size())) > 0)
+    {
+        if (target->write(chunk.constData(), n) != n)
+            return false;
+    }
+
+    // A deflate error ends the reads early too
+    return gzip.atEnd() && target->flush() && target->seek(0);
+}
+
+
 //
 // XPPrivatePutWorker
 //
 
 void XPPrivatePutWorker::doWork()
 {
-    m_file.setFileName(m_controller->localFilePath());
-    if (!m_file.open(QFile::ReadOnly))
+    // Aborted after the slot was given, the slot goes with the worker
+    if (m_aborted)
     {
-        m_errorString = "Unable to open local file for reading";
-        wakeController();
+        deleteLater();
         return;
     }
 
-    // Open a network manager to do the file transfer
-    m_netManager = new QNetworkAccessManager(this);
-    connect(m_netManager, SIGNAL(finished(QNetworkReply*)), this, SLOT(onFinished(QNetworkReply*)));
+    m_stats.start();
 
+    if (m_source == &m_buffer)
+    {
+        m_buffer.open(QIODevice::ReadOnly);
+    }
+    else
+    {
+        m_file.setFileName(m_localPath);
+        if (!m_file.open(QFile::ReadOnly))
+        {
+            m_errorString = "Unable to open local file for reading";
+            wakeController();
+            return;
+        }
+    }
+
+    // Use the hub's shared network manager to reuse its connections
+    m_netManager = XPNetPool::instance()->networkManager(m_url);
+
+#ifdef XPNETFILE_USE_DELTA
+    // Send a patch if it's much smaller than the file
+    if (m_source == &m_file && m_delta.isValid() && !m_deltaETag.isEmpty()
+        && XPNetPool::instance()->acceptsDelta(m_url))
+    {
+        QByteArray patch = m_delta.diff(&m_file);
+        if (patch.size() < m_file.size()/100*XPNETDELTA_MAXRATIO)
+        {
+            m_patch.setData(patch);
+            m_deltaMode = true;
+        }
+        qDebug() << ">> doWork() patch size=" << patch.size() << "file size=" << m_file.size();
+        m_file.seek(0);
+    }
+#endif
+
+    startPut();
+}
+
+void XPPrivatePutWorker::setDelta(const XPNetDelta& delta, const QByteArray& eTag)
+{
+    m_delta = delta;
+    m_deltaETag = eTag;
+}
+
+void XPPrivatePutWorker::startPut()
+{
     // Build the request
     QNetworkRequest request;
-    request.setUrl(m_controller->m_url);
+    request.setUrl(m_url);
+    request.setPriority(XPNetPool::requestPriority(this));
+    QIODevice *body = m_source;
 
-    // POST request is asynchronous
-    m_netReply = m_netManager->put(request, &m_file);
+    if (m_deltaMode)
+    {
+        // The hub applies the patch to the version we have cached
+        m_patch.close();
+        m_patch.open(QIODevice::ReadOnly);
+        request.setHeader(QNetworkRequest::ContentTypeHeader, XPNETDELTA_CONTENTTYPE);
+        request.setRawHeader("If-Match", m_deltaETag);
+        body = &m_patch;
+    }
+#ifdef XPNETFILE_USE_GZIP
+    else if (m_source->size() >= XPNETFILE_GZIP_MINSIZE && XPNetPool::instance()->acceptsGzip(m_url))
+    {
+        // Small files are not worth the gzip header and trailer
+        m_gzip = new QTemporaryFile(this);
+        if (m_gzip->open() && gzipTo(m_source, m_gzip))
+        {
+            request.setRawHeader("Content-Encoding", "gzip");
+            request.setHeader(QNetworkRequest::ContentLengthHeader, m_gzip->size());
+            body = m_gzip;
+        }
+        else
+        {
+            qDebug() << ">> startPut() gzip error=" << m_gzip->errorString();
+            delete m_gzip;
+            m_gzip = 0;
+            m_source->seek(0);
+        }
+    }
+#endif
+
+    // PUT request is asynchronous
+    m_netReply = m_netManager->put(request, body);
     connect(m_netReply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(onError(QNetworkReply::NetworkError)));
+    connect(m_netReply, SIGNAL(uploadProgress(qint64,qint64)), this, SLOT(onUploadProgress(qint64,qint64)));
+    connect(m_netReply, SIGNAL(finished()), this, SLOT(onFinished()));
 
-    qDebug() << "Executing PUT request...";
+    qDebug() << "Executing PUT request... gzip=" << (m_gzip != 0) << "delta=" << m_deltaMode;
 }
 
-void XPPrivatePutWorker::onError(QNetworkReply::NetworkError netError)
+void XPPrivatePutWorker::abort()
 {
-    m_file.close();
-    //QFile::remove(m_controller->localFilePath());
+    // Still waiting for a slot, nobody wants the transfer any more
+    m_aborted = true;
+    if (XPNetPool::instance()->cancel(this))
+    {
+        deleteLater();
+        return;
+    }
 
+    // The reply reports OperationCanceledError and then finishes
+    if (m_netReply && m_netReply->isRunning())
+        m_netReply->abort();
+}
+
+void XPPrivatePutWorker::onError(QNetworkReply::NetworkError netError)
+{
     m_errorString = m_netReply->errorString();
-    wakeController();
 
     qDebug() << ">> onError=" << netError << "msg=" << m_errorString;
 }
 
-void XPPrivatePutWorker::onFinished(QNetworkReply *reply)
+void XPPrivatePutWorker::onUploadProgress(qint64 bytesSent, qint64 bytesTotal)
+{
+    Q_UNUSED(bytesTotal);
+
+    m_attemptSent = bytesSent;
+}
+
+void XPPrivatePutWorker::onFinished()
 {
-    Q_UNUSED(reply);
+    int status = m_netReply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+    // The response headers come with the reply to a PUT
+    m_stats.markFirstByte();
+    XPNetPool::instance()->noteCapabilities(m_url, m_netReply);
+    m_stats.addBytesOut(m_attemptSent);
+    m_attemptSent = 0;
+
+    // Send the whole file if the hub can't take the patch
+    if (m_deltaMode)
+    {
+        bool unsupported = (status == 400 || status == 415 || status == 501);
+        if (unsupported)
+            XPNetPool::instance()->setAcceptsDelta(m_url, false);
+
+        if (unsupported || status == 412) // 412: the hub's version changed
+        {
+            m_deltaMode = false;
+            restartPut();
+            return;
+        }
+    }
+
+    // Send the plain file if the hub can't take a gzip body
+    else if (m_gzip)
+    {
+        bool refused = (status == 400 || status == 415 || status == 501);
+        XPNetPool::instance()->setAcceptsGzip(m_url, !refused);
+
+        m_gzip->deleteLater();
+        m_gzip = 0;
 
-    m_file.close();
+        if (refused)
+        {
+            restartPut();
+            return;
+        }
+    }
+
+    // The cached file is now the hub's version
+    QString localPath = QFileInfo(m_localPath).absoluteFilePath();
+    if (m_errorString.isEmpty() && localPath.startsWith(XPNetEtagIndex::instance()->cacheRoot()+"/"))
+    {
+        QByteArray eTag = m_netReply->rawHeader("ETag");
+        if (!eTag.isEmpty())
+        {
+            XPNetEtagIndex::instance()->setValue(localPath, eTag);
+            XPNetPackStore::instance()->store(localPath);
+        }
+        else
+            XPNetEtagIndex::instance()->remove(localPath);
+    }
+
+    // onError() has already run for failed transfers
+    m_source->close();
     wakeController();
 
     qDebug() << ">> onFinished() file transfer complete!";
 }
 
+void XPPrivatePutWorker::restartPut()
+{
+    m_stats.addRetry();
+    m_netReply->deleteLater();
+    m_netReply = 0;
+    m_errorString = "";
+
+    if (!m_source->seek(0))
+    {
+        m_errorString = "Unable to rewind local file";
+        m_source->close();
+        wakeController();
+        return;
+    }
+
+    startPut();
+}
+
 void XPPrivatePutWorker::wakeController()
 {
-    m_controller->m_mutex.lock();
-    m_controller->m_workComplete.wakeOne();
-    m_controller->m_mutex.unlock();
+    int status = m_netReply ? m_netReply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() : 0;
+    m_stats.record("PUT", m_url, status, m_errorString.isEmpty() ? XPNetMetrics::Sent : XPNetMetrics::Failed);
+
+    if (m_netReply)
+        m_netReply->deleteLater();
+
+    emit finished(m_errorString);
+
+    // The worker lives on a pool thread and is no longer needed
+    deleteLater();
 }
 
 // End of file
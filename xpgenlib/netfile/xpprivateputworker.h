@@ -22,10 +22,15 @@
 #define XPPRIVATEPUTWORKER_H
 
 #include <QFile>
+#include <QBuffer>
+#include <QTemporaryFile>
 #include <QNetworkReply>
 #include <QNetworkAccessManager>
 
 #include "xpnetfile.h"
+#include "xpgzipdevice.h"
+#include "xpnetdelta.h"
+#include "xpnetmetrics.h"
 
 
 class XPPrivatePutWorker : public QObject
@@ -33,28 +38,54 @@ class XPPrivatePutWorker : public QObject
     Q_OBJECT
 
 public:
-    explicit XPPrivatePutWorker(XPNetFile* controller, QObject *parent = 0)
-                : QObject(parent), m_controller(controller) {}
+    explicit XPPrivatePutWorker(const QUrl& url, const QString& localPath, QObject *parent = 0)
+                : QObject(parent), m_url(url), m_localPath(localPath), m_netReply(0), m_netManager(0),
+                  m_aborted(false), m_source(&m_file), m_gzip(0), m_deltaMode(false), m_attemptSent(0) {}
+    // Send a buffer, there is no local file
+    explicit XPPrivatePutWorker(const QUrl& url, const QByteArray& data, QObject *parent = 0)
+                : QObject(parent), m_url(url), m_netReply(0), m_netManager(0),
+                  m_aborted(false), m_source(&m_buffer), m_gzip(0), m_deltaMode(false), m_attemptSent(0) { m_buffer.setData(data); }
 
-    QString errorString() { return m_errorString; }
+    // Send a patch against the hub's version with this signature and ETag
+    void setDelta(const XPNetDelta& delta, const QByteArray& eTag);
+
+signals:
+    void finished(QString errorString);
 
 public slots:
     void doWork();
+    void abort();
 
 private slots:
     void onError(QNetworkReply::NetworkError netError);
-    void onFinished(QNetworkReply *reply);
+    void onUploadProgress(qint64 bytesSent, qint64 bytesTotal);
+    void onFinished();
 
 private:
+    void startPut();
+    void restartPut();
     void wakeController();
 
 private:
-    XPNetFile* m_controller;
+    QUrl m_url;
+    QString m_localPath;
     //
     QFile m_file;
+    QBuffer m_buffer;
     QString m_errorString;
     QNetworkReply* m_netReply;
     QNetworkAccessManager *m_netManager;
+    bool m_aborted; // before doWork() ran, it does nothing
+    QIODevice *m_source; // m_file or m_buffer
+    QTemporaryFile *m_gzip; // the gzip encoded body while it is sent
+    //
+    XPNetDelta m_delta;
+    QByteArray m_deltaETag;
+    QBuffer m_patch;
+    //
+    XPNetTransferStats m_stats;
+    qint64 m_attemptSent; // bytes of the body sent by the current attempt
+    bool m_deltaMode; // set while the body is a patch
 };
 
 #endif // XPPRIVATEPUTWORKER_H
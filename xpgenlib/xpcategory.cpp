@@ -26,6 +26,7 @@
 #include <QXmlStreamReader>
 
 #include <xpnetfile.h>
+#include <xpnetfileview.h>
 #include "xpcategory.h"
 
 XPCategory::XPCategory(const QString &rmlCachePath, const QString &hostAddress, QObject *parent) :
@@ -63,29 +64,130 @@ QIcon XPCategory::getIcon(const QString& category, int size)
     if (!m_valid)
         return QIcon(":images/document-close.svg");
 
+    // Find the icon file for 'category' in the group for size
+    QString iconPath = getIconPath(category, size);
+    if (iconPath.isEmpty())
+    {
+        qDebug() << "XPCategory::getIcon category code not found";
+        return QIcon(":images/unknown-device.png"); // unknown device icon
+    }
+    QString localPath = QString("%1/%2").arg(rmlCachePath).arg(iconPath);
+
+    // Get category icon file from HUB unless prefetch() already did
+    if (m_missing.contains(localPath))
+    {
+        qDebug() << "XPCategory::getIcon icon file not found";
+        return QIcon(":images/document-close.svg"); // error icon
+    }
+    else if (!m_fetched.contains(localPath))
+    {
+        QUrl url = QUrl(QString("http://%1/%2").arg(hostAddress).arg(iconPath));
+
+        XPNetFile iconFile(url, localPath);
+        if (!iconFile.exists())
+        {
+            qDebug() << "XPCategory::getIcon icon file not found";
+            return QIcon(":images/document-close.svg"); // error icon
+        }
+    }
+
+    return QIcon(localPath);
+}
+
+QString XPCategory::getIconPath(const QString& category, int size)
+{
     // Find the entry for 'category' in the group for size
     QString group = QString("%1x%1").arg(size);
     QSettings ini(indexFilePath, QSettings::IniFormat);
     QStringList values = ini.value(QString("%1/%2").arg(group).arg(category),
                                    QString("%1/0000").arg(group)).toStringList();
     if (values.count() != 2)
+        return QString();
+
+    return QString("categories/default/%1/%2").arg(group).arg(values[1]);
+}
+
+QHash<QPair<QString, QString>, QString> XPCategory::prefetch(const QList<QPair<QString, QString> >& models, int size)
+{
+    QHash<QPair<QString, QString>, QString> categories;
+
+    // (1) Get default RML files (std.prf) for models with no local RML
+    //
+    QSet<QString> modelPaths;
+    QList<XPNetBatchItem> items;
+    for (int i=0, n=models.count(); i<n && !hostAddress.isEmpty(); i++)
     {
-        qDebug() << "XPCategory::getIcon category code not found";
-        return QIcon(":images/unknown-device.png"); // unknown device icon
+        QString manufacturer = models.at(i).first;
+        QString mmodel = models.at(i).second;
+
+        QDir dir(QString("%1/profiles/%2/%3").arg(rmlCachePath).arg(manufacturer).arg(mmodel));
+        if (dir.exists() && dir.entryList(QStringList("*.prf"), QDir::Files).count())
+            continue;
+
+        // Many devices can share a model
+        QString modelPath = QString("profiles/%1/%2/std.prf").arg(manufacturer).arg(mmodel);
+        if (modelPaths.contains(modelPath))
+            continue;
+        modelPaths.insert(modelPath);
+
+        items.append(XPNetBatchItem(QUrl(QString("http://%1/%2").arg(hostAddress).arg(modelPath)),
+                                    QString("%1/%2").arg(rmlCachePath).arg(modelPath)));
+    }
+    fetchBatch(items);
+
+    // (2) Parse each model's RML once, the caller gets the codes
+    //
+    for (int i=0, n=models.count(); i<n; i++)
+    {
+        if (!categories.contains(models.at(i)))
+            categories.insert(models.at(i), getCategory(models.at(i).first, models.at(i).second));
     }
 
-    // Get category icon file from HUB
-    QString iconPath = QString("categories/default/%1/%2").arg(group).arg(values[1]);
-    QUrl url = QUrl(QString("http://%1/%2").arg(hostAddress).arg(iconPath));
+    if (!m_valid || hostAddress.isEmpty())
+        return categories;
 
-    XPNetFile iconFile(url, QString("%1/%2").arg(rmlCachePath).arg(iconPath));
-    if (!iconFile.exists())
+    // (3) Get the icon files of all the categories found
+    //
+    QSet<QString> iconPaths;
+    foreach (const QString& catcode, categories)
     {
-        qDebug() << "XPCategory::getIcon icon file not found";
-        return QIcon(":images/document-close.svg"); // error icon
+        if (catcode.isEmpty())
+            continue;
+
+        QString iconPath = getIconPath(catcode, size);
+        if (!iconPath.isEmpty())
+            iconPaths.insert(iconPath);
+    }
+
+    items.clear();
+    foreach (const QString& iconPath, iconPaths)
+    {
+        items.append(XPNetBatchItem(QUrl(QString("http://%1/%2").arg(hostAddress).arg(iconPath)),
+                                    QString("%1/%2").arg(rmlCachePath).arg(iconPath)));
+    }
+    fetchBatch(items);
+
+    return categories;
+}
+
+void XPCategory::fetchBatch(const QList<XPNetBatchItem>& items)
+{
+    if (items.isEmpty())
+        return;
+
+    XPNetBatch *batch = XPNetFile::fetchMany(items);
+    batch->waitForFinished();
+
+    // Remember the results so the per device calls stay local
+    for (int i=0, n=batch->count(); i<n; i++)
+    {
+        if (batch->isOk(i))
+            m_fetched.insert(batch->localFilePath(i));
+        else if (!batch->isPending(i))
+            m_missing.insert(batch->localFilePath(i));
     }
 
-    return QIcon(QString("%1/%2").arg(rmlCachePath).arg(iconPath));
+    delete batch;
 }
 
 QString XPCategory::getDescription(const QString& category, int size)
@@ -109,7 +211,7 @@ QString XPCategory::getDescription(const QString& category, int size)
 
 QString XPCategory::getCategory(const QString& manufacturer, const QString& mmodel)
 {
-    QIODevice *rmlFile = 0;
+    XPNetFileView rml;
 
     // Try and get an RML file from the local cache
     //
@@ -123,34 +225,36 @@ QString XPCategory::getCategory(const QString& manufacturer, const QString& mmod
         if (fl.count()) // the first one will do
         {
             QString filePath = fl.at(0).filePath();
-            QFile *localFile = new QFile(filePath);
-            localFile->open(QFile::ReadOnly);
-            rmlFile = localFile;
+            rml.map(filePath);
             qDebug() << "XPCategory::getCategory local path=" << filePath;
         }
     }
 
     // Get default RML file from HUB (std.prf)
     //
-    if (rmlFile == 0)
+    if (!rml.isValid())
     {
         QString modelPath = QString("profiles/%1/%2/std.prf").arg(manufacturer).arg(mmodel);
         QString filePath = QString("%1/%2").arg(rmlCachePath).arg(modelPath);
         QUrl url = QUrl(QString("http://%1/%2").arg(hostAddress).arg(modelPath));
 
-        XPNetFile *remoteFile = new XPNetFile(url, filePath);
-        if (!remoteFile->exists())
+        if (m_missing.contains(filePath))
+        {
+            qDebug() << "XPCategory::getCategory RML file not found";
+            return QString();
+        }
+
+        XPNetFile remoteFile(url, filePath);
+        if (!remoteFile.map(rml))
         {
             qDebug() << "XPCategory::getCategory RML file not found";
             return QString();
         }
-        remoteFile->open(QFile::ReadOnly);
-        rmlFile = remoteFile;
     }
 
-    // Parse the RML and get the category code
+    // Parse the mapped RML in place and get the category code
     //
-    QXmlStreamReader reader(rmlFile);
+    QXmlStreamReader reader(rml.bytes());
 
     while (!reader.atEnd())
     {
@@ -168,7 +272,6 @@ QString XPCategory::getCategory(const QString& manufacturer, const QString& mmod
         QString message = tr("XML syntax error in RML:\n%1.").arg(reader.errorString());
         qDebug() << "XPCategory::getCategory" << message;
     }
-    delete rmlFile;
 
     return QString();
 }
@@ -180,20 +283,20 @@ QStringList XPCategory::getGroupData(int size)
     if (!m_valid)
         return result;
 
-    // Open category index file
+    // Map category index file
     //
-    QFile indexFile(indexFilePath);
-    if (!indexFile.open(QFile::ReadOnly))
+    XPNetFileView indexFile;
+    if (!indexFile.map(indexFilePath))
     {
         qDebug() << "XPCategory::getGroupData open error=" << indexFile.errorString();
         return result;
     }
 
-    // Read all index data and find the group [sizexsize]
+    // Find the group [sizexsize] in the mapped index data
     //
     int pos1, pos2;
-    QString group = QString("[%1x%1]").arg(size);
-    QString ini = indexFile.readAll();
+    QByteArray group = QString("[%1x%1]").arg(size).toUtf8();
+    QByteArray ini = indexFile.bytes();
 
     // Find first line of group
     pos1 = ini.indexOf(group);
@@ -211,7 +314,7 @@ QStringList XPCategory::getGroupData(int size)
         if (pos2 <= pos1)
             break;
 
-        QString line = ini.mid(pos1, pos2-pos1).trimmed();
+        QString line = QString::fromUtf8(ini.constData()+pos1, pos2-pos1).trimmed(); // only the group's lines are copied
         if (line.isEmpty() || (line.startsWith("[") && line.endsWith("]")))
             break;
 
@@ -21,10 +21,15 @@
 #ifndef XPCATEGORY_H
 #define XPCATEGORY_H
 
+#include <QSet>
+#include <QHash>
+#include <QPair>
 #include <QObject>
 #include <QString>
 #include <QIcon>
 
+#include <xpnetbatch.h>
+
 class XPCategory : public QObject
 {
     Q_OBJECT
@@ -45,10 +50,18 @@ public:
     QString getDescription(const QString& category, int size);
     QIcon getIcon(const QString& category, int size);
 
+    // Fetch the profiles and icons of many devices (manufacturer, mmodel) together,
+    // returns the category code of each model, empty if not found
+    QHash<QPair<QString, QString>, QString> prefetch(const QList<QPair<QString, QString> >& models, int size = 72);
+
 signals:
 
 public slots:
 
+private:
+    QString getIconPath(const QString& category, int size);
+    void fetchBatch(const QList<XPNetBatchItem>& items);
+
 private:
     bool m_valid;
     QString rmlCachePath;
@@ -58,6 +71,9 @@ private:
     QString m_theme;
     QString m_comment;
     QList<int> m_sizes;
+    //
+    QSet<QString> m_fetched; // local paths already validated by prefetch()
+    QSet<QString> m_missing; // local paths the hub does not have
 };
 
 #endif // XPCATEGORY_H